@@ -0,0 +1,81 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Relaxed: only the totals matter, not their order against other memory
+static atomic<size_t> total_allocations(0);
+static atomic<size_t> total_bytes(0);
+
+void *operator new(size_t size) {
+  total_allocations.fetch_add(1, memory_order_relaxed);
+  total_bytes.fetch_add(size, memory_order_relaxed);
+
+  // malloc(0) may return NULL, new must not
+  if (size == 0) {
+    size = 1;
+  }
+
+  // Like the standard new, give the new handler (which may free memory or
+  // throw itself) a chance before failing
+  void *memory;
+  while ((memory = malloc(size)) == NULL) {
+    new_handler handler = get_new_handler();
+    if (handler == NULL) {
+      throw bad_alloc();
+    }
+    handler();
+  }
+  return memory;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+  try {
+    return operator new(size);
+  } catch (const bad_alloc &) {
+    return NULL;
+  }
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+  return operator new(size, nothrow);
+}
+
+void operator delete(void *memory) noexcept {
+  free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+  free(memory);
+}
+
+void operator delete(void *memory, const nothrow_t &) noexcept {
+  free(memory);
+}
+
+void operator delete[](void *memory, const nothrow_t &) noexcept {
+  free(memory);
+}
+
+AllocationCount allocation_count() {
+  AllocationCount count;
+  count.allocations = total_allocations.load(memory_order_relaxed);
+  count.bytes = total_bytes.load(memory_order_relaxed);
+  return count;
+}
+
+AllocationCount allocations_since(const AllocationCount &start) {
+  AllocationCount now = allocation_count();
+  AllocationCount difference;
+  difference.allocations = now.allocations - start.allocations;
+  difference.bytes = now.bytes - start.bytes;
+  return difference;
+}
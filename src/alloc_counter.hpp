@@ -0,0 +1,30 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+using namespace std;
+
+/* Counts every heap allocation the program makes through operator new.
+ *
+ * alloc_counter.cpp replaces the global operator new and delete, so the
+ * count covers all threads and the standard containers too. Take a count
+ * before and after a piece of work and compare, e.g. the renderer reports
+ * allocations per megabyte loaded once a scene is in, which makes a load
+ * path that starts copying again easy to spot.
+ */
+
+struct AllocationCount {
+  size_t allocations;
+  size_t bytes;
+
+  AllocationCount() : allocations(0), bytes(0) {}
+};
+
+// Totals since the program started
+AllocationCount allocation_count();
+
+// What happened between two counts
+AllocationCount allocations_since(const AllocationCount &start);
+
+#endif
@@ -13,14 +13,14 @@
 using namespace std;
 
 // Parse lines for setting up camera transforms
-Camera :: Camera(vector<string> lines) {
+Camera :: Camera(const vector<string> &lines) {
   set_position(lines[1]);
   set_orient(lines[2]);
   set_perspective(lines);
 }
 
 // Parse position translation line
-void Camera :: set_position(string line) {
+void Camera :: set_position(const string &line) {
   istringstream line_stream(line);
 
   string _;
@@ -33,7 +33,7 @@ void Camera :: set_position(string line) {
 }
 
 // Parse position orientation rotation line
-void Camera :: set_orient(string line) {
+void Camera :: set_orient(const string &line) {
   istringstream line_stream(line);
 
   string orientation;
@@ -49,7 +49,7 @@ void Camera :: set_orient(string line) {
 }
 
 // Get all arguments for perspective projection transform
-void Camera :: set_perspective(vector<string> lines) {
+void Camera :: set_perspective(const vector<string> &lines) {
   istringstream near_line_stream(lines[3]);
   string _;
   if (!(near_line_stream >> _ >> near)) {
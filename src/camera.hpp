@@ -21,14 +21,14 @@ struct Camera {
   double near, far, left, right, top, bottom;
 
   // Parse lines for setting up camera transforms
-  Camera(vector<string> lines);
+  Camera(const vector<string> &lines);
 
   // Parse position translation line
-  void set_position(string line);
+  void set_position(const string &line);
   // Parse position orientation rotation line
-  void set_orient(string line);
+  void set_orient(const string &line);
   // Get all arguments for perspective projection transform
-  void set_perspective(vector<string> lines);
+  void set_perspective(const vector<string> &lines);
 };
 
 #endif
@@ -0,0 +1,310 @@
+#include "compact_mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+static_assert(sizeof(CompactMeshHeader) == 72, "Header must not be padded");
+
+static bool is_little_endian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+}
+
+// Distance between quantization levels along one axis, 0 for a flat axis
+static double quantization_step(float min_value, float max_value, int bits) {
+  double levels = double((uint32_t(1) << bits) - 1);
+  return (double(max_value) - double(min_value)) / levels;
+}
+
+// Encoder and decoder must agree on this exactly for the error bound to hold
+static float dequantize(float min_value, double step, uint32_t q) {
+  return float(double(min_value) + step * q);
+}
+
+static uint32_t quantize(float value, float min_value, double step, int bits) {
+  if (step == 0) {
+    return 0;
+  }
+  double q = floor((double(value) - double(min_value)) / step + 0.5);
+  double levels = double((uint32_t(1) << bits) - 1);
+  return uint32_t(max(0.0, min(q, levels)));
+}
+
+static void put_varint(vector<char> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(char((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(char(value));
+}
+
+static uint32_t zigzag(int32_t value) {
+  return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+// Read one varint, throws if it runs past end
+static uint32_t get_varint(const unsigned char *&p, const unsigned char *end) {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (p == end) {
+      throw "Truncated face data in compact mesh";
+    }
+    unsigned char byte = *p++;
+    value |= uint32_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw "Bad varint in compact mesh";
+}
+
+// Rotate (a, b, c) so the smallest index is first, keeping the winding
+static Face rotate_to_smallest(const Face &face) {
+  int a = face.vertex1, b = face.vertex2, c = face.vertex3;
+  if (b < a && b <= c) {
+    return Face(b, c, a);
+  }
+  if (c < a && c < b) {
+    return Face(c, a, b);
+  }
+  return face;
+}
+
+static bool face_less(const Face &x, const Face &y) {
+  if (x.vertex1 != y.vertex1) {
+    return x.vertex1 < y.vertex1;
+  }
+  if (x.vertex2 != y.vertex2) {
+    return x.vertex2 < y.vertex2;
+  }
+  return x.vertex3 < y.vertex3;
+}
+
+vector<char> encode_compact_mesh(const Model &model, int position_bits,
+    CompactMeshInfo *info) {
+  if (!is_little_endian()) {
+    throw "Compact meshes can only be written on little-endian hosts";
+  }
+  if (position_bits < 1 || position_bits > 30) {
+    throw "Compact mesh position bits must be between 1 and 30";
+  }
+
+  size_t num_vertices = model.vertices.empty() ? 0 : model.vertices.size() - 1;
+  const Vertex *vertices = model.vertices.data() + 1;
+
+  CompactMeshHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPACT_MESH_MAGIC, sizeof(header.magic));
+  header.position_bits = position_bits;
+  header.num_vertices = num_vertices;
+  header.num_faces = model.faces.size();
+
+  if (num_vertices > 0) {
+    Vertex min_corner, max_corner;
+    model.get_bounds(min_corner, max_corner);
+    header.min_corner[0] = min_corner.x;
+    header.min_corner[1] = min_corner.y;
+    header.min_corner[2] = min_corner.z;
+    header.max_corner[0] = max_corner.x;
+    header.max_corner[1] = max_corner.y;
+    header.max_corner[2] = max_corner.z;
+  }
+
+  double step[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    step[axis] = quantization_step(header.min_corner[axis],
+        header.max_corner[axis], position_bits);
+  }
+
+  // Positions, packed least significant bit first
+  vector<char> positions;
+  positions.reserve((num_vertices * 3 * position_bits + 7) / 8);
+  uint64_t bit_buffer = 0;
+  int bit_count = 0;
+  double max_error = 0;
+
+  for (size_t i = 0; i < num_vertices; ++i) {
+    const float coords[3] = {vertices[i].x, vertices[i].y, vertices[i].z};
+    for (int axis = 0; axis < 3; ++axis) {
+      uint32_t q = quantize(coords[axis], header.min_corner[axis], step[axis],
+          position_bits);
+      float decoded = dequantize(header.min_corner[axis], step[axis], q);
+      max_error = max(max_error, fabs(double(decoded) - double(coords[axis])));
+
+      bit_buffer |= uint64_t(q) << bit_count;
+      bit_count += position_bits;
+      while (bit_count >= 8) {
+        positions.push_back(char(bit_buffer & 0xff));
+        bit_buffer >>= 8;
+        bit_count -= 8;
+      }
+    }
+  }
+  if (bit_count > 0) {
+    positions.push_back(char(bit_buffer & 0xff));
+  }
+
+  // Faces, 0-based in the file
+  vector<Face> sorted_faces;
+  sorted_faces.reserve(model.faces.size());
+  for (size_t i = 0; i < model.faces.size(); ++i) {
+    const Face &face = model.faces[i];
+    sorted_faces.push_back(rotate_to_smallest(
+          Face(face.vertex1 - 1, face.vertex2 - 1, face.vertex3 - 1)));
+  }
+  sort(sorted_faces.begin(), sorted_faces.end(), face_less);
+
+  vector<char> face_data;
+  face_data.reserve(sorted_faces.size() * 4);
+  int32_t previous = 0;
+  for (size_t i = 0; i < sorted_faces.size(); ++i) {
+    const Face &face = sorted_faces[i];
+    put_varint(face_data, zigzag(face.vertex1 - previous));
+    put_varint(face_data, zigzag(face.vertex2 - face.vertex1));
+    put_varint(face_data, zigzag(face.vertex3 - face.vertex1));
+    previous = face.vertex1;
+  }
+
+  header.position_bytes = positions.size();
+  header.face_bytes = face_data.size();
+
+  vector<char> out(sizeof(header) + positions.size() + face_data.size());
+  memcpy(out.data(), &header, sizeof(header));
+  if (!positions.empty()) {
+    memcpy(out.data() + sizeof(header), positions.data(), positions.size());
+  }
+  if (!face_data.empty()) {
+    memcpy(out.data() + sizeof(header) + positions.size(), face_data.data(),
+        face_data.size());
+  }
+
+  if (info != NULL) {
+    info->max_error = max_error;
+    info->file_size = out.size();
+  }
+  return out;
+}
+
+void decode_compact_mesh(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces) {
+  if (!is_little_endian()) {
+    throw "Compact meshes can only be read on little-endian hosts";
+  }
+
+  CompactMeshHeader header;
+  if (size_t(end - begin) < sizeof(header)) {
+    throw "Truncated compact mesh header";
+  }
+  memcpy(&header, begin, sizeof(header));
+
+  int bits = header.position_bits;
+  if (memcmp(header.magic, COMPACT_MESH_MAGIC, sizeof(header.magic)) != 0) {
+    throw "Not a compact mesh file";
+  }
+  if (bits < 1 || bits > 30) {
+    throw "Bad position bits in compact mesh";
+  }
+  if ((header.num_vertices * 3 * bits + 7) / 8 != header.position_bytes
+      || size_t(end - begin) != sizeof(header) + header.position_bytes
+        + header.face_bytes) {
+    throw "Compact mesh size does not match its header";
+  }
+
+  double step[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    step[axis] = quantization_step(header.min_corner[axis],
+        header.max_corner[axis], bits);
+  }
+
+  // Positions
+  const unsigned char *p =
+    reinterpret_cast<const unsigned char *>(begin + sizeof(header));
+  const unsigned char *face_begin = p + header.position_bytes;
+  const uint32_t mask = (uint32_t(1) << bits) - 1;
+  uint64_t bit_buffer = 0;
+  int bit_count = 0;
+
+  int base = vertices.size();
+  vertices.resize(base + header.num_vertices);
+  Vertex *out = vertices.data() + base;
+
+  for (uint64_t i = 0; i < header.num_vertices; ++i) {
+    float coords[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      while (bit_count < bits) {
+        bit_buffer |= uint64_t(*p++) << bit_count;
+        bit_count += 8;
+      }
+      uint32_t q = uint32_t(bit_buffer) & mask;
+      bit_buffer >>= bits;
+      bit_count -= bits;
+      coords[axis] = dequantize(header.min_corner[axis], step[axis], q);
+    }
+    out[i].x = coords[0];
+    out[i].y = coords[1];
+    out[i].z = coords[2];
+  }
+
+  // Faces
+  p = face_begin;
+  const unsigned char *face_end = face_begin + header.face_bytes;
+  int64_t num_vertices = header.num_vertices;
+  int32_t previous = 0;
+
+  faces.reserve(faces.size() + header.num_faces);
+  for (uint64_t i = 0; i < header.num_faces; ++i) {
+    int32_t a = previous + unzigzag(get_varint(p, face_end));
+    int32_t b = a + unzigzag(get_varint(p, face_end));
+    int32_t c = a + unzigzag(get_varint(p, face_end));
+    if (a < 0 || b < 0 || c < 0
+        || a >= num_vertices || b >= num_vertices || c >= num_vertices) {
+      throw "Bad vertex index in compact mesh";
+    }
+    faces.push_back(Face(base + a, base + b, base + c));
+    previous = a;
+  }
+  if (p != face_end) {
+    throw "Trailing face data in compact mesh";
+  }
+}
+
+bool write_compact_mesh(const string &file_name, const Model &model,
+    int position_bits, CompactMeshInfo *info) {
+  vector<char> data = encode_compact_mesh(model, position_bits, info);
+
+  FILE *out = fopen(file_name.c_str(), "wb");
+  if (out == NULL) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+  ok = (fclose(out) == 0) && ok;
+  if (!ok) {
+    remove(file_name.c_str());
+  }
+  return ok;
+}
+
+bool parse_compact_mesh_file(const string &file_name, Model &model) {
+  MappedFile file;
+  if (!file.open(file_name)) {
+    return false;
+  }
+
+  decode_compact_mesh(file.data(), file.end(), model.vertices, model.faces);
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef COMPACT_MESH_HPP
+#define COMPACT_MESH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+/* Compact .cmesh format for archiving and moving meshes around.
+ *
+ * Positions are quantized to position_bits per axis inside the bounding box
+ * and bit packed. Faces are rotated so their smallest index comes first
+ * (keeping the winding), sorted by it, and written as varints: the change
+ * in first index from the previous face, then the other two corners as
+ * zigzag offsets from the first. Sorted faces keep neighbouring triangles
+ * together, so most deltas fit in one byte.
+ *
+ * Layout (little-endian):
+ *   CompactMeshHeader
+ *   position bits (num_vertices * 3 * position_bits, padded to a byte)
+ *   face varints (face_bytes)
+ */
+
+const char COMPACT_MESH_MAGIC[8] = {'C', 'M', 'E', 'S', 'H', 0, 0, 1};
+const int COMPACT_MESH_DEFAULT_BITS = 16;
+
+struct CompactMeshHeader {
+  char magic[8];
+  uint32_t position_bits;
+  uint32_t reserved;
+  uint64_t num_vertices;
+  uint64_t num_faces;
+  float min_corner[3];
+  float max_corner[3];
+  uint64_t position_bytes;
+  uint64_t face_bytes;
+};
+
+// What write_compact_mesh produced
+struct CompactMeshInfo {
+  // Largest distance along any axis between a vertex and its decoded value
+  double max_error;
+  size_t file_size;
+};
+
+// Encode model, position_bits must be in [1, 30]
+vector<char> encode_compact_mesh(const Model &model, int position_bits,
+    CompactMeshInfo *info = NULL);
+
+// Decode a .cmesh buffer, appending to vertices and faces
+void decode_compact_mesh(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces);
+
+// Write model to file_name, false if the file can not be written
+bool write_compact_mesh(const string &file_name, const Model &model,
+    int position_bits = COMPACT_MESH_DEFAULT_BITS, CompactMeshInfo *info = NULL);
+
+// Map file_name and decode it into model, false if it can not be mapped
+bool parse_compact_mesh_file(const string &file_name, Model &model);
+
+#endif
@@ -15,7 +15,7 @@ using namespace std;
 
 using MatrixPtr = shared_ptr<Eigen::MatrixXd>;
 
-MatrixPtr inverse_transform(vector<string> lines) {
+MatrixPtr inverse_transform(const vector<string> &lines) {
   MatrixPtr prod = multiply_matrices(lines);
   MatrixPtr res = MatrixPtr(new Eigen::MatrixXd(4, 4));
   *res =  prod->inverse();
@@ -33,24 +33,23 @@ vector<string> parse_file_to_line_vector(char *file_name) {
   return lines;
 }
 
-MatrixPtr multiply_matrices(vector<string> lines) {
+MatrixPtr multiply_matrices(const vector<string> &lines) {
   MatrixPtr prod = MatrixPtr(new Eigen::MatrixXd(4, 4));
   prod->setIdentity(4, 4);
 
-  for (vector<string>::iterator line_it = lines.begin(); line_it != lines.end(); ++line_it) {
+  for (vector<string>::const_iterator line_it = lines.begin(); line_it != lines.end(); ++line_it) {
     multiply_into_matrix(*line_it, prod);
   }
 
   return prod;
 }
 
-MatrixPtr create_norm_trans_mat(vector<string> lines) {
+MatrixPtr create_norm_trans_mat(const vector<string> &lines) {
   MatrixPtr prod = MatrixPtr(new Eigen::MatrixXd(4, 4));
   prod->setIdentity(4, 4);
 
-  for (vector<string>::iterator line_it = lines.begin(); line_it != lines.end(); ++line_it) {
-    string line = *line_it;
-    if (!is_translation_line(line)) {
+  for (vector<string>::const_iterator line_it = lines.begin(); line_it != lines.end(); ++line_it) {
+    if (!is_translation_line(*line_it)) {
       multiply_into_matrix(*line_it, prod);
     }
   }
@@ -61,12 +60,12 @@ MatrixPtr create_norm_trans_mat(vector<string> lines) {
   return prod;
 }
 
-void multiply_into_matrix(string line, MatrixPtr mat) {
+void multiply_into_matrix(const string &line, const MatrixPtr &mat) {
   MatrixPtr new_mat = parse_transform_line(line);
   *mat = *new_mat * *mat;
 }
 
-MatrixPtr parse_transform_line(string line) {
+MatrixPtr parse_transform_line(const string &line) {
   if (is_translation_line(line)) {
     return parse_translation_line(line);
 
@@ -78,19 +77,19 @@ MatrixPtr parse_transform_line(string line) {
   }
 }
 
-bool is_translation_line(string line) {
+bool is_translation_line(const string &line) {
   return line.at(0) == 't';
 }
 
-bool is_rotation_line(string line) {
+bool is_rotation_line(const string &line) {
   return line.at(0) == 'r';
 }
 
-bool is_scaling_line(string line) {
+bool is_scaling_line(const string &line) {
   return line.at(0) == 's';
 }
 
-MatrixPtr parse_scaling_line(string line) {
+MatrixPtr parse_scaling_line(const string &line) {
   istringstream line_stream(line);
   char s;
   double s_x, s_y, s_z;
@@ -101,7 +100,7 @@ MatrixPtr parse_scaling_line(string line) {
   return create_scaling_mat(s_x, s_y, s_z);
 }
 
-MatrixPtr parse_translation_line(string line) {
+MatrixPtr parse_translation_line(const string &line) {
   istringstream line_stream(line);
   char t;
   double t_x, t_y, t_z;
@@ -112,7 +111,7 @@ MatrixPtr parse_translation_line(string line) {
   return create_translation_mat(t_x, t_y, t_z);
 }
 
-MatrixPtr parse_rotation_line(string line) {
+MatrixPtr parse_rotation_line(const string &line) {
   istringstream line_stream(line);
   char r;
   double r_x, r_y, r_z, angle_in_rad;
@@ -176,14 +175,15 @@ MatrixPtr create_rot_mat_helper(double u_x, double u_y, double u_z, double angle
   return mat;
 }
 
-Vertex transform_vertex(MatrixPtr trans_mat, Vertex vertex) {
-  MatrixPtr vertex_mat = MatrixPtr(new Eigen::MatrixXd(4, 1));
-  *vertex_mat << vertex.x, // row1
-                 vertex.y, // row2
-                 vertex.z, // row3
-                 1;         // row4
+Vertex transform_vertex(const MatrixPtr &trans_mat, const Vertex &vertex) {
+  return transform_vertex(Eigen::Matrix4d(*trans_mat), vertex);
+}
 
-  Eigen::MatrixXd transformed = *trans_mat * *vertex_mat;
+Vertex transform_vertex(const Eigen::Matrix4d &trans_mat,
+    const Vertex &vertex) {
+  // Fixed size, so nothing goes on the heap
+  Eigen::Vector4d transformed =
+    trans_mat * Eigen::Vector4d(vertex.x, vertex.y, vertex.z, 1);
 
   double new_x = transformed(0) / transformed(3);
   double new_y = transformed(1) / transformed(3);
@@ -192,7 +192,7 @@ Vertex transform_vertex(MatrixPtr trans_mat, Vertex vertex) {
   return Vertex(new_x, new_y, new_z);
 }
 
-Normal transform_normal(MatrixPtr trans_mat, Normal normal) {
+Normal transform_normal(const MatrixPtr &trans_mat, const Normal &normal) {
   MatrixPtr normal_mat = MatrixPtr(new Eigen::MatrixXd(4, 1));
   *normal_mat << normal.x, // row1
                  normal.y, // row2
@@ -208,7 +208,7 @@ Normal transform_normal(MatrixPtr trans_mat, Normal normal) {
   return Normal(new_x, new_y, new_z);
 }
 
-Vertex scale_vertex(double factor, Vertex vertex) {
+Vertex scale_vertex(double factor, const Vertex &vertex) {
   double new_x = vertex.x * factor;
   double new_y = vertex.y * factor;
   double new_z = vertex.z * factor;
@@ -13,31 +13,31 @@ using namespace std;
 using MatrixPtr = shared_ptr<Eigen::MatrixXd>;
 
 // Return the inverse transform from the vector of lines transformed to matrices
-MatrixPtr inverse_transform(vector<string> lines);
+MatrixPtr inverse_transform(const vector<string> &lines);
 
 // Reads file and returns input to inverse_transform
 vector<string> parse_file_to_line_vector(char *file_name);
 
 // Multiply multiple vectors after transforming to matrices
-MatrixPtr multiply_matrices(vector<string> lines);
+MatrixPtr multiply_matrices(const vector<string> &lines);
 // Multiply multiple normals after transforming to matrices
-MatrixPtr create_norm_trans_mat(vector<string> lines);
+MatrixPtr create_norm_trans_mat(const vector<string> &lines);
 
 // Return line_mat times mat
-void multiply_into_matrix(string line, MatrixPtr mat);
+void multiply_into_matrix(const string &line, const MatrixPtr &mat);
 
 // Parse a single line
-MatrixPtr parse_transform_line(string line);
+MatrixPtr parse_transform_line(const string &line);
 
 // Helper functions for checking type of line
-bool is_translation_line(string line);
-bool is_rotation_line(string line);
-bool is_scaling_line(string line);
+bool is_translation_line(const string &line);
+bool is_rotation_line(const string &line);
+bool is_scaling_line(const string &line);
 
 // Helper functions for parsing types of lines
-MatrixPtr parse_translation_line(string line);
-MatrixPtr parse_scaling_line(string line);
-MatrixPtr parse_rotation_line(string line);
+MatrixPtr parse_translation_line(const string &line);
+MatrixPtr parse_scaling_line(const string &line);
+MatrixPtr parse_rotation_line(const string &line);
 
 // Creating respective matrices from inputs
 MatrixPtr create_translation_mat(double t_x, double t_y, double t_z);
@@ -47,8 +47,11 @@ MatrixPtr create_rotation_mat(double r_x, double r_y, double r_z, double angle_i
 MatrixPtr create_rot_mat_helper(double u_x, double u_y, double u_z, double angle_in_rad);
 
 // Multiply vertex coordinates by matrix or scalar
-Vertex transform_vertex(MatrixPtr trans_mat, Vertex vertex);
-Normal transform_normal(MatrixPtr trans_mat, Normal vertex);
-Vertex scale_vertex(double factor, Vertex vertex);
+Vertex transform_vertex(const MatrixPtr &trans_mat, const Vertex &vertex);
+// Same without any allocation, for transforming many vertices
+Vertex transform_vertex(const Eigen::Matrix4d &trans_mat,
+    const Vertex &vertex);
+Normal transform_normal(const MatrixPtr &trans_mat, const Normal &vertex);
+Vertex scale_vertex(double factor, const Vertex &vertex);
 
 #endif
@@ -0,0 +1,291 @@
+#include "gzip_input.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "compact_mesh.hpp"
+#include "mesh_stream.hpp"
+#include "model.hpp"
+#include "parser.hpp"
+#include "ply_parser.hpp"
+
+using namespace std;
+
+// Compressed bytes read from the file at a time
+static const size_t GZIP_READ_SIZE = 1 << 18;
+
+/* Inflates a gzip file on its own thread into a bounded queue of blocks.
+ *
+ * next hands the blocks out in order on the calling thread and rethrows
+ * anything that went wrong while inflating. Destroying the reader stops
+ * the thread even if not everything was read.
+ */
+class InflateThread {
+  public:
+    // Takes ownership of fd
+    InflateThread(int fd);
+    ~InflateThread();
+
+    // Swap the next block into block, false once the data has run out
+    bool next(vector<char> &block);
+
+  private:
+    int fd;
+    thread worker;
+
+    // Guarded by queue_mutex
+    mutex queue_mutex;
+    condition_variable queue_changed;
+    deque<vector<char> > full_blocks;
+    vector<vector<char> > spare_blocks;
+    bool finished;
+    bool cancelled;
+    exception_ptr error;
+
+    void run();
+    void inflate_file();
+    // Queue block, false if the reader was cancelled meanwhile
+    bool push_block(vector<char> &block);
+
+    InflateThread(const InflateThread &);
+    InflateThread &operator=(const InflateThread &);
+};
+
+InflateThread :: InflateThread(int fd)
+  : fd(fd), finished(false), cancelled(false) {
+  worker = thread(&InflateThread::run, this);
+}
+
+InflateThread :: ~InflateThread() {
+  {
+    lock_guard<mutex> lock(queue_mutex);
+    cancelled = true;
+  }
+  queue_changed.notify_all();
+  worker.join();
+  close(fd);
+}
+
+bool InflateThread :: next(vector<char> &block) {
+  unique_lock<mutex> lock(queue_mutex);
+  queue_changed.wait(lock, [this]() {
+    return !full_blocks.empty() || finished;
+  });
+
+  // Data inflated before an error still goes out first, like a short read
+  if (full_blocks.empty()) {
+    if (error) {
+      rethrow_exception(error);
+    }
+    return false;
+  }
+
+  block.swap(full_blocks.front());
+  spare_blocks.push_back(vector<char>());
+  spare_blocks.back().swap(full_blocks.front());
+  full_blocks.pop_front();
+  lock.unlock();
+
+  queue_changed.notify_all();
+  return true;
+}
+
+bool InflateThread :: push_block(vector<char> &block) {
+  unique_lock<mutex> lock(queue_mutex);
+  queue_changed.wait(lock, [this]() {
+    return full_blocks.size() < GZIP_QUEUE_BLOCKS || cancelled;
+  });
+  if (cancelled) {
+    return false;
+  }
+
+  full_blocks.push_back(vector<char>());
+  full_blocks.back().swap(block);
+
+  // Reuse a block the parser is done with
+  if (!spare_blocks.empty()) {
+    block.swap(spare_blocks.back());
+    spare_blocks.pop_back();
+  }
+  lock.unlock();
+
+  queue_changed.notify_all();
+  return true;
+}
+
+void InflateThread :: run() {
+  try {
+    inflate_file();
+  } catch (...) {
+    lock_guard<mutex> lock(queue_mutex);
+    error = current_exception();
+  }
+
+  {
+    lock_guard<mutex> lock(queue_mutex);
+    finished = true;
+  }
+  queue_changed.notify_all();
+}
+
+// Refill the input of stream from fd, false at the end of the file
+static bool read_input(int fd, z_stream &stream, vector<unsigned char> &input) {
+  ssize_t bytes_read = read(fd, input.data(), input.size());
+  if (bytes_read < 0) {
+    throw "Error reading gzip file";
+  }
+  stream.next_in = input.data();
+  stream.avail_in = bytes_read;
+  return bytes_read > 0;
+}
+
+void InflateThread :: inflate_file() {
+  z_stream stream = z_stream();
+  // 16 + MAX_WBITS: expect a gzip header and trailer
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+    throw "Could not start inflating gzip file";
+  }
+
+  vector<unsigned char> input(GZIP_READ_SIZE);
+  vector<char> block;
+  bool at_member_end = false;
+  bool at_file_end = false;
+
+  try {
+    while (true) {
+      if (at_member_end) {
+        if (stream.avail_in == 0 && !read_input(fd, stream, input)) {
+          break;
+        }
+        // Concatenated gzip files (e.g. from cat a.gz b.gz) are one stream
+        inflateReset(&stream);
+        at_member_end = false;
+      }
+
+      block.resize(GZIP_BLOCK_SIZE);
+      stream.next_out = reinterpret_cast<Bytef *>(block.data());
+      stream.avail_out = block.size();
+
+      while (stream.avail_out > 0 && !at_member_end) {
+        if (stream.avail_in == 0 && !read_input(fd, stream, input)) {
+          at_file_end = true;
+          break;
+        }
+
+        int status = inflate(&stream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+          at_member_end = true;
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+          throw "Corrupt gzip data";
+        }
+      }
+
+      block.resize(block.size() - stream.avail_out);
+      if (!block.empty() && !push_block(block)) {
+        break;
+      }
+      if (at_file_end) {
+        throw "Truncated gzip file";
+      }
+    }
+  } catch (...) {
+    inflateEnd(&stream);
+    throw;
+  }
+
+  inflateEnd(&stream);
+}
+
+bool is_gzip_file(const string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  unsigned char magic[2];
+  bool gzip = read(fd, magic, sizeof(magic)) == sizeof(magic)
+    && magic[0] == 0x1f && magic[1] == 0x8b;
+  close(fd);
+  return gzip;
+}
+
+// Open file_name for one sequential pass, -1 if it can not be opened
+static int open_sequential(const string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  return fd;
+}
+
+bool stream_gzip_obj_file(const string &file_name, MeshSink &sink,
+    size_t batch_size) {
+  int fd = open_sequential(file_name);
+  if (fd < 0) {
+    return false;
+  }
+
+  InflateThread inflater(fd);
+  ObjStreamParser parser(sink, batch_size);
+  vector<char> block;
+
+  while (inflater.next(block)) {
+    parser.feed(block.data(), block.size());
+  }
+  parser.finish();
+  return true;
+}
+
+bool read_gzip_file(const string &file_name, vector<char> &data) {
+  int fd = open_sequential(file_name);
+  if (fd < 0) {
+    return false;
+  }
+
+  InflateThread inflater(fd);
+  vector<char> block;
+
+  data.clear();
+  while (inflater.next(block)) {
+    data.insert(data.end(), block.begin(), block.end());
+  }
+  return true;
+}
+
+bool parse_gzip_mesh_file(const string &file_name, Model &model) {
+  // The format is in the name without .gz (bunny.ply.gz), or in the name
+  // itself when a compressed file kept it (bunny.cmesh)
+  string inner_name = file_name;
+  if (has_extension(inner_name, ".gz")) {
+    inner_name.resize(inner_name.size() - 3);
+  }
+
+  bool ply = has_extension(inner_name, ".ply");
+  if (ply || has_extension(inner_name, ".cmesh")) {
+    vector<char> data;
+    if (!read_gzip_file(file_name, data)) {
+      return false;
+    }
+    if (ply) {
+      parse_ply_buffer(data.data(), data.data() + data.size(),
+          model.vertices, model.faces);
+    } else {
+      decode_compact_mesh(data.data(), data.data() + data.size(),
+          model.vertices, model.faces);
+    }
+    return true;
+  }
+
+  ModelSink sink(model);
+  return stream_gzip_obj_file(file_name, sink);
+}
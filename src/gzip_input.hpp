@@ -0,0 +1,42 @@
+#ifndef GZIP_INPUT_HPP
+#define GZIP_INPUT_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "mesh_stream.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+/* Reading gzip compressed meshes (e.g. bunny.obj.gz) without temp files.
+ *
+ * A separate thread reads the file and inflates it into a small queue of
+ * blocks while the calling thread parses the blocks it has already
+ * produced, so inflate and parsing overlap. .obj text goes through
+ * ObjStreamParser; .ply and .cmesh are inflated into memory and parsed as a
+ * buffer. Compressed files are recognized by their magic bytes, the format
+ * inside by the name without .gz.
+ */
+
+// Blocks of inflated data handed from the inflate thread to the parser
+const size_t GZIP_BLOCK_SIZE = 1 << 20;
+// Blocks the inflate thread may run ahead of the parser
+const size_t GZIP_QUEUE_BLOCKS = 4;
+
+// True if file_name starts with the gzip magic bytes
+bool is_gzip_file(const string &file_name);
+
+// Inflate file_name into sink as .obj text, false if it can not be opened
+bool stream_gzip_obj_file(const string &file_name, MeshSink &sink,
+    size_t batch_size = MESH_STREAM_BATCH_SIZE);
+
+// Inflate all of file_name into data, false if it can not be opened
+bool read_gzip_file(const string &file_name, vector<char> &data);
+
+// Parse a gzip compressed .ply, .cmesh (if the name without .gz says so)
+// or otherwise .obj into model, false if it can not be opened
+bool parse_gzip_mesh_file(const string &file_name, Model &model);
+
+#endif
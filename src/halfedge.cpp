@@ -1,217 +1,517 @@
 #include "halfedge.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <map>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <utility>
 #include <vector>
 
+#include "parallel.hpp"
 #include "structs.hpp"
 
 #include "Eigen/Dense"
 
 using namespace std;
 
-pair<int, int> get_edge_key(int x, int y) {
-  assert(x != y);
-  return pair<int, int>(min(x, y), max(x, y));
-}
+// Faces handed to each parallel_for item while building
+static const size_t BUILD_CHUNK = 1 << 14;
+// Vertices whose edges one parallel_for item matches
+static const size_t MATCH_GROUP = 1 << 12;
 
-void hash_edge(map<pair<int, int>, HE*> &edge_hash,
-    pair<int, int> edge_key,
-    HE *edge) {
-  if(edge_hash.count(edge_key) != 0) {
-    HE *flip = edge_hash[edge_key];
-    flip->flip = edge;
-    edge->flip = flip;
-  }
-  else
-    edge_hash[edge_key] = edge;
+// True unless edge and its flip leave the same vertex, i.e. their faces
+// wind opposite ways
+static bool check_flip(const HalfedgeMesh &mesh, uint32_t edge) {
+  uint32_t flip = mesh.edges[edge].flip;
+  return flip == NO_HALFEDGE || mesh.edges[flip].vertex != mesh.edges[edge].vertex;
 }
 
-bool check_flip(HE *edge) {
-  return edge->flip == NULL || edge->flip->vertex != edge->vertex;
+// The smaller vertex of the edge a halfedge lies on
+static uint32_t smaller_vertex(const HalfedgeMesh &mesh, uint32_t he) {
+  return min(mesh.edges[he].vertex, mesh.edges[HalfedgeMesh::next(he)].vertex);
 }
 
-bool check_edge(HE *edge) {
-  return check_flip(edge) || !edge->face->oriented || !edge->flip->face->oriented;
-}
+/* Pairs every halfedge with the first halfedge before it on the same edge
+ * (a later third one takes over the first one's flip), without a map.
+ *
+ * Halfedges are counting sorted by their smaller vertex in two passes: into
+ * groups of MATCH_GROUP vertices first, chunk by chunk so the chunks can run
+ * in parallel and still keep face order, then into one bucket per vertex
+ * within each group (the larger vertex is looked up only then). Each
+ * bucket is only as big as the vertex's degree, so sorting it on (larger
+ * vertex, halfedge) is cheap and lines up the halfedges of each edge. No two
+ * groups hold the same halfedge, so they are matched in parallel too, and
+ * the flips do not depend on the number of threads.
+ */
+static void match_flips(HalfedgeMesh &mesh) {
+  size_t num_faces = mesh.num_faces();
+  size_t num_chunks = (num_faces + BUILD_CHUNK - 1) / BUILD_CHUNK;
+  size_t num_groups = (mesh.num_vertices() + MATCH_GROUP - 1) / MATCH_GROUP;
+
+  // Halfedges each chunk has in each group, then where in its group they go
+  vector<uint32_t> chunk_group(num_chunks * num_groups, 0);
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    uint32_t *counts = &chunk_group[begin / BUILD_CHUNK * num_groups];
+    for (size_t he = 3 * begin; he < 3 * end; ++he) {
+      assert(mesh.edges[he].vertex
+          != mesh.edges[HalfedgeMesh::next(he)].vertex);
+      ++counts[smaller_vertex(mesh, he) / MATCH_GROUP];
+    }
+  });
+
+  vector<uint32_t> group_start(num_groups + 1, 0);
+  uint32_t position = 0;
+  for (size_t g = 0; g < num_groups; ++g) {
+    group_start[g] = position;
+    for (size_t c = 0; c < num_chunks; ++c) {
+      uint32_t count = chunk_group[c * num_groups + g];
+      chunk_group[c * num_groups + g] = position;
+      position += count;
+    }
+  }
+  group_start[num_groups] = position;
+
+  // Smaller vertex in the high half, halfedge in the low half
+  vector<uint64_t> bucket_edges(mesh.edges.size());
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    uint32_t *next = &chunk_group[begin / BUILD_CHUNK * num_groups];
+    for (size_t he = 3 * begin; he < 3 * end; ++he) {
+      uint32_t smaller = smaller_vertex(mesh, he);
+      bucket_edges[next[smaller / MATCH_GROUP]++] =
+        ((uint64_t) smaller << 32) | he;
+    }
+  });
 
-bool check_face(HEF *face) {
-  bool b1 = check_edge(face->edge);
-  bool b2 = (face->edge->next != NULL) ? check_edge(face->edge->next) : 1;
-  bool b3;
+  parallel_for(num_groups, [&](size_t g) {
+    if (group_start[g] == group_start[g + 1]) {
+      return;
+    }
+    uint64_t *group = bucket_edges.data() + group_start[g];
+    vector<uint64_t> group_edges(group,
+        bucket_edges.data() + group_start[g + 1]);
+    uint32_t first_vertex = g * MATCH_GROUP;
+
+    vector<uint32_t> bucket_start(MATCH_GROUP + 1, 0);
+    for (size_t i = 0; i < group_edges.size(); ++i) {
+      ++bucket_start[(group_edges[i] >> 32) - first_vertex + 1];
+    }
+    for (size_t b = 0; b < MATCH_GROUP; ++b) {
+      bucket_start[b + 1] += bucket_start[b];
+    }
 
-  if(face->edge->next != NULL) {
-    b3 = (face->edge->next->next != NULL) ? check_edge(face->edge->next->next) : 1;
-  } else {
-    b3 = 1;
-  }
+    // Now larger vertex in the high half
+    {
+      vector<uint32_t> next(bucket_start.begin(), bucket_start.end() - 1);
+      for (size_t i = 0; i < group_edges.size(); ++i) {
+        uint32_t smaller = group_edges[i] >> 32;
+        uint32_t he = (uint32_t) group_edges[i];
+        uint32_t larger = mesh.edges[he].vertex
+          ^ mesh.edges[HalfedgeMesh::next(he)].vertex ^ smaller;
+        group[next[smaller - first_vertex]++] = ((uint64_t) larger << 32) | he;
+      }
+    }
 
-  return b1 && b2 && b3;
+    for (size_t b = 0; b < MATCH_GROUP; ++b) {
+      uint64_t *begin = group + bucket_start[b];
+      uint64_t *end = group + bucket_start[b + 1];
+      sort(begin, end);
+
+      while (begin < end) {
+        uint32_t first = (uint32_t) *begin;
+        uint64_t *same = begin + 1;
+        for (; same < end && (*same >> 32) == (*begin >> 32); ++same) {
+          uint32_t edge = (uint32_t) *same;
+          mesh.edges[first].flip = edge;
+          mesh.edges[edge].flip = first;
+        }
+        begin = same;
+      }
+    }
+  });
 }
 
-bool orient_flip_face(HE *edge) {
-  if(edge->flip == NULL) {
-    return 1;
-  }
-
-  HE *flip = edge->flip;
-  HEF *face = flip->face;
+/* Labels the connected components of the faces (faces joined by flips).
+ *
+ * A concurrent union-find: every face starts as its own root and every
+ * flip joins the roots of its two faces, always hanging the larger root
+ * under the smaller one with a compare and swap. So each component ends up
+ * rooted at its smallest face whatever the number of threads, and the
+ * components are numbered in order of that face.
+ */
+static void label_components(HalfedgeMesh &mesh) {
+  size_t num_faces = mesh.num_faces();
+  vector<atomic<uint32_t> > parent(num_faces);
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    for (size_t f = begin; f < end; ++f) {
+      parent[f].store(f, memory_order_relaxed);
+    }
+  });
+
+  // Parents only ever point to smaller faces, so pointing a face at its
+  // grandparent on the way up (path halving) is safe from any thread
+  auto find_root = [&](uint32_t face) {
+    uint32_t up = parent[face].load(memory_order_relaxed);
+    while (up != face) {
+      uint32_t grandparent = parent[up].load(memory_order_relaxed);
+      if (grandparent != up) {
+        parent[face].compare_exchange_weak(up, grandparent,
+            memory_order_relaxed);
+      }
+      face = grandparent;
+      up = parent[face].load(memory_order_relaxed);
+    }
+    return face;
+  };
+
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    for (size_t he = 3 * begin; he < 3 * end; ++he) {
+      uint32_t flip = mesh.edges[he].flip;
+      // A pair of flips only needs joining once
+      if (flip == NO_HALFEDGE || (flip < he && mesh.edges[flip].flip == he)) {
+        continue;
+      }
+
+      uint32_t a = HalfedgeMesh::face(he);
+      uint32_t b = HalfedgeMesh::face(flip);
+      while (true) {
+        a = find_root(a);
+        b = find_root(b);
+        if (a == b) {
+          break;
+        }
+        if (a < b) {
+          swap(a, b);
+        }
+        uint32_t expected = a;
+        if (parent[a].compare_exchange_strong(expected, b,
+              memory_order_relaxed)) {
+          break;
+        }
+      }
+    }
+  });
 
-  if(face->oriented) {
-    return check_face(face);
+  // Component of each face, by first face until numbered
+  vector<uint32_t> component(num_faces);
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    for (size_t f = begin; f < end; ++f) {
+      component[f] = find_root(f);
+    }
+  });
+
+  // Number the components and count their faces, then counting sort the
+  // faces by component, keeping face order
+  mesh.component_start.assign(1, 0);
+  for (size_t f = 0; f < num_faces; ++f) {
+    if (component[f] == f) {
+      component[f] = mesh.component_start.size() - 1;
+      mesh.component_start.push_back(0);
+    } else {
+      component[f] = component[component[f]];
+    }
+    ++mesh.component_start[component[f] + 1];
   }
-
-  if (!check_flip(edge)) {
-    HEV *v1 = face->edge->vertex;
-    HEV *v2 = face->edge->next->vertex;
-    HEV *v3 = face->edge->next->next->vertex;
-
-    assert(v1 != v2 && v1 != v3 && v2 != v3);
-
-    HE *e3 = face->edge;
-    HE *e1 = face->edge->next;
-    HE *e2 = face->edge->next->next;
-
-    assert(e3->vertex == v1);
-    assert(e1->vertex == v2);
-    assert(e2->vertex == v3);
-
-    e3->vertex = v3;
-    e3->next = e2;
-
-    e1->vertex = v1;
-    e1->next = e3;
-
-    e2->vertex = v2;
-    e2->next = e1;
-
-    v1->out = e3;
-    v2->out = e1;
-    v3->out = e2;
-
-    assert(face->edge->next->next->next == face->edge);
+  size_t num_components = mesh.num_components();
+  for (size_t c = 0; c < num_components; ++c) {
+    mesh.component_start[c + 1] += mesh.component_start[c];
   }
 
-  face->oriented = 1;
-
-  assert(check_flip(edge));
-  assert(check_face(face));
-
-  return check_face(face) && orient_face(face);
-}
-
-bool orient_face(HEF *face) {
-  assert(face->oriented);
-  return orient_flip_face(face->edge)
-    && orient_flip_face(face->edge->next)
-    && orient_flip_face(face->edge->next->next)
-    && check_face(face);
+  mesh.component_faces.resize(num_faces);
+  if (num_components == 1) {
+    parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+      for (size_t f = begin; f < end; ++f) {
+        mesh.component_faces[f] = f;
+      }
+    });
+    return;
+  }
+  vector<uint32_t> next(mesh.component_start.begin(),
+      mesh.component_start.end() - 1);
+  for (size_t f = 0; f < num_faces; ++f) {
+    mesh.component_faces[next[component[f]]++] = f;
+  }
 }
 
-bool build_HE(Mesh_Data *mesh, vector<HEV *> *hevs, vector<HEF *> *hefs) {
-  vector<Vertex> *vertices = mesh->vertices;
-  vector<Face> *faces = mesh->faces;
-
-  hevs->push_back(NULL);
-  map<pair<int, int>, HE*> edge_hash;
+// What orienting knows of a face, as of the level before
+static const char NOT_REACHED = 0;
+static const char KEPT = 1;
+static const char REVERSED = 2;
+// Not reached over any halfedge yet
+static const uint32_t NOT_SEEN = UINT32_MAX;
+
+/* Works out which faces of first's component to reverse to agree with
+ * first, into state.
+ *
+ * The faces are reached one breadth first level at a time, with the faces
+ * of a level worked through in parallel (levels narrower than a chunk stay
+ * on one thread, starting threads for them would cost more). A face reached
+ * from several faces of the level before follows the smallest halfedge it
+ * was reached over, so the result does not depend on the number of
+ * threads. reached_over holds that halfedge, shifted up past whether the
+ * face has to be reversed to agree with it. Components share no faces, so
+ * several can be worked out at once over the same state. Returns false if
+ * some edge ends up between faces that disagree anyway (the surface is not
+ * orientable).
+ */
+static bool orient_component(const HalfedgeMesh &mesh, uint32_t first,
+    vector<char> &state, vector<atomic<uint32_t> > &reached_over) {
+  state[first] = KEPT;
+  vector<uint32_t> level(1, first);
+  bool consistent = 1;
+
+  while (!level.empty()) {
+    // Faces each chunk of the level reached first, and whether the chunk
+    // found no edge between reached faces that disagree
+    size_t num_chunks = (level.size() + BUILD_CHUNK - 1) / BUILD_CHUNK;
+    vector<vector<uint32_t> > found(num_chunks);
+    vector<char> chunk_consistent(num_chunks, 1);
+
+    parallel_chunks(level.size(), BUILD_CHUNK, [&](size_t begin, size_t end) {
+      vector<uint32_t> &found_faces = found[begin / BUILD_CHUNK];
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t edge = HalfedgeMesh::face_edge(level[i]);
+        bool face_reversed = state[level[i]] == REVERSED;
+
+        for (uint32_t he = edge; he < edge + 3; ++he) {
+          uint32_t flip = mesh.edges[he].flip;
+          if (flip == NO_HALFEDGE) {
+            continue;
+          }
+
+          uint32_t face = HalfedgeMesh::face(flip);
+          bool reverse = face_reversed != !check_flip(mesh, he);
+          if (state[face] != NOT_REACHED) {
+            if ((state[face] == REVERSED) != reverse) {
+              chunk_consistent[begin / BUILD_CHUNK] = 0;
+            }
+            continue;
+          }
+
+          uint32_t over = (he << 1) | reverse;
+          uint32_t seen = reached_over[face].load(memory_order_relaxed);
+          while (over < seen && !reached_over[face].compare_exchange_weak(
+                seen, over, memory_order_relaxed)) {
+          }
+          if (seen == NOT_SEEN) {
+            found_faces.push_back(face);
+          }
+        }
+      }
+    });
+
+    level.clear();
+    for (size_t c = 0; c < num_chunks; ++c) {
+      level.insert(level.end(), found[c].begin(), found[c].end());
+      consistent = consistent && chunk_consistent[c];
+    }
 
-  int size_vertices = vertices->size();
+    parallel_chunks(level.size(), BUILD_CHUNK, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t face = level[i];
+        bool reverse = reached_over[face].load(memory_order_relaxed) & 1;
+        state[face] = reverse ? REVERSED : KEPT;
+      }
+    });
+  }
 
-  for(int i = 1; i < size_vertices; ++i) {
-    HEV *hev = new HEV;
-    hev->x = vertices->at(i).x;
-    hev->y = vertices->at(i).y;
-    hev->z = vertices->at(i).z;
-    hev->out = NULL;
-    hev->index = i;
+  return consistent;
+}
 
-    hevs->push_back(hev);
+/* Orients every component like its first face.
+ *
+ * Components of at least a chunk of faces are worked out one after the
+ * other, each with its levels in parallel; the smaller ones (debris, loose
+ * parts) are spread over the threads a component at a time. The faces
+ * found to disagree are then all reversed at once, in parallel. Returns
+ * false if some component is not orientable, but still orients everything
+ * else.
+ */
+static bool orient_components(HalfedgeMesh &mesh) {
+  size_t num_faces = mesh.num_faces();
+  vector<char> state(num_faces, NOT_REACHED);
+  // (build_HE keeps halfedge indices below 2^31)
+  vector<atomic<uint32_t> > reached_over(num_faces);
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      reached_over[i].store(NOT_SEEN, memory_order_relaxed);
+    }
+  });
+
+  bool consistent = 1;
+  vector<uint32_t> small_components;
+  for (size_t c = 0; c < mesh.num_components(); ++c) {
+    uint32_t first = mesh.component_faces[mesh.component_start[c]];
+    if (mesh.component_start[c + 1] - mesh.component_start[c] < BUILD_CHUNK) {
+      small_components.push_back(c);
+    } else if (!orient_component(mesh, first, state, reached_over)) {
+      consistent = 0;
+    }
   }
 
-  HEF *first_face = NULL;
-  int num_faces = faces->size();
+  vector<char> small_consistent(small_components.size(), 1);
+  parallel_for(small_components.size(), [&](size_t i) {
+    uint32_t first =
+      mesh.component_faces[mesh.component_start[small_components[i]]];
+    small_consistent[i] = orient_component(mesh, first, state, reached_over);
+  });
+  if (find(small_consistent.begin(), small_consistent.end(), 0)
+      != small_consistent.end()) {
+    consistent = 0;
+  }
 
-  for (int i = 0; i < num_faces; ++i) {
-    Face f = faces->at(i);
+  // A reversed face goes from (v1, v2, v3) to (v1, v3, v2). Its halfedge
+  // in slot k keeps its edge but moves to slot 2 - k, which every flip to
+  // it has to follow.
+  auto moved = [&](uint32_t he) -> uint32_t {
+    if (he == NO_HALFEDGE || state[HalfedgeMesh::face(he)] != REVERSED) {
+      return he;
+    }
+    return he - he % 3 + (2 - he % 3);
+  };
+
+  if (find(state.begin(), state.end(), REVERSED) != state.end()) {
+    parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+      for (size_t f = begin; f < end; ++f) {
+        HE *edges = &mesh.edges[HalfedgeMesh::face_edge(f)];
+        if (state[f] != REVERSED) {
+          for (int k = 0; k < 3; ++k) {
+            edges[k].flip = moved(edges[k].flip);
+          }
+          continue;
+        }
+
+        HE before[3] = {edges[0], edges[1], edges[2]};
+        assert(before[0].vertex != before[1].vertex
+            && before[0].vertex != before[2].vertex
+            && before[1].vertex != before[2].vertex);
+        for (int k = 0; k < 3; ++k) {
+          edges[k].vertex = before[(3 - k) % 3].vertex;
+          edges[k].flip = moved(before[2 - k].flip);
+        }
+      }
+    });
+  }
 
-    HE *e1 = new HE;
-    HE *e2 = new HE;
-    HE *e3 = new HE;
+  return consistent;
+}
 
-    e1->flip = NULL;
-    e2->flip = NULL;
-    e3->flip = NULL;
+// Corners of a face read straight from Face
+class FaceCorners {
+  public:
+    FaceCorners(const vector<Face> &faces) : faces(faces) {
+    }
 
-    HEF *hef = new HEF;
+    void get(size_t i, int &v1, int &v2, int &v3) const {
+      v1 = faces[i].vertex1;
+      v2 = faces[i].vertex2;
+      v3 = faces[i].vertex3;
+    }
 
-    hef->oriented = 0;
-    hef->edge = e1;
+  private:
+    const vector<Face> &faces;
+};
 
-    e1->face = hef;
-    e2->face = hef;
-    e3->face = hef;
+// Corners of a face read from a triangle list of any index width
+template<typename Index>
+class IndexCorners {
+  public:
+    IndexCorners(const Index *corners) : corners(corners) {
+    }
 
-    e1->next = e2;
-    e2->next = e3;
-    e3->next = e1;
+    void get(size_t i, int &v1, int &v2, int &v3) const {
+      v1 = corners[3 * i];
+      v2 = corners[3 * i + 1];
+      v3 = corners[3 * i + 2];
+    }
 
-    e1->vertex = hevs->at(f.vertex1);
-    e2->vertex = hevs->at(f.vertex2);
-    e3->vertex = hevs->at(f.vertex3);
+  private:
+    const Index *corners;
+};
 
-    hevs->at(f.vertex1)->out = e1;
-    hevs->at(f.vertex2)->out = e2;
-    hevs->at(f.vertex3)->out = e3;
+template<typename Corners>
+static bool build_HE_from(const Corners &corners, size_t num_faces,
+    size_t num_vertices, HalfedgeMesh &mesh) {
+  // Leaves orienting a bit to spare
+  if (3 * num_faces >= (size_t(1) << 31)) {
+    throw "Too many faces for a halfedge mesh";
+  }
+  mesh.edges.resize(3 * num_faces);
+
+  parallel_chunks(num_faces, BUILD_CHUNK, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      int v[3];
+      corners.get(i, v[0], v[1], v[2]);
+
+      for (int k = 0; k < 3; ++k) {
+        if (v[k] < 1 || (size_t) v[k] >= num_vertices) {
+          throw "Face refers to a missing vertex";
+        }
+        mesh.edges[3 * i + k].vertex = v[k];
+        mesh.edges[3 * i + k].flip = NO_HALFEDGE;
+      }
+    }
+  });
+  mesh.out.assign(num_vertices, NO_HALFEDGE);
 
-    hash_edge(edge_hash, get_edge_key(f.vertex1, f.vertex2), e1);
-    hash_edge(edge_hash, get_edge_key(f.vertex2, f.vertex3), e2);
-    hash_edge(edge_hash, get_edge_key(f.vertex3, f.vertex1), e3);
+  match_flips(mesh);
+  label_components(mesh);
 
-    hefs->push_back(hef);
+  bool consistent = orient_components(mesh);
 
-    if(first_face == NULL) {
-      first_face = hef;
-      first_face->oriented = 1;
+  // The last halfedge out of each vertex, once orienting has moved them.
+  // Walks around a vertex on an open boundary have to start at the
+  // boundary to reach every face, so there it is the halfedge with the
+  // boundary edge right before it.
+  for (size_t he = 0; he < mesh.edges.size(); ++he) {
+    mesh.out[mesh.edges[he].vertex] = he;
+  }
+  for (size_t he = 0; he < mesh.edges.size(); ++he) {
+    if (mesh.edges[HalfedgeMesh::prev(he)].flip == NO_HALFEDGE) {
+      mesh.out[mesh.edges[he].vertex] = he;
     }
   }
 
-  return orient_face(first_face);
+  return consistent;
 }
 
-void delete_HE(vector<HEV*> *hevs, vector<HEF*> *hefs) {
-  int hev_size = hevs->size();
-  int num_hefs = hefs->size();
-
-  for(int i = 1; i < hev_size; ++i) {
-    delete hevs->at(i);
-  }
-
-  for(int i = 0; i < num_hefs; ++i) {
-    delete hefs->at(i)->edge->next->next;
-    delete hefs->at(i)->edge->next;
-    delete hefs->at(i)->edge;
-    delete hefs->at(i);
-  }
+bool build_HE(const vector<Face> &faces, size_t num_vertices,
+    HalfedgeMesh &mesh) {
+  return build_HE_from(FaceCorners(faces), faces.size(), num_vertices, mesh);
+}
 
-  delete hevs;
-  delete hefs;
+template<typename Index>
+bool build_HE(const Index *corners, size_t num_faces, size_t num_vertices,
+    HalfedgeMesh &mesh) {
+  return build_HE_from(IndexCorners<Index>(corners), num_faces, num_vertices,
+      mesh);
 }
 
-Eigen::Vector3d HEV_to_vec(HEV* vertex) {
-  return Eigen::Vector3d(vertex->x, vertex->y, vertex->z);
+template bool build_HE<uint16_t>(const uint16_t *, size_t, size_t,
+    HalfedgeMesh &);
+template bool build_HE<uint32_t>(const uint32_t *, size_t, size_t,
+    HalfedgeMesh &);
+
+Eigen::Vector3d vertex_to_vec(const vector<Vertex> &vertices, uint32_t vertex) {
+  const Vertex &v = vertices[vertex];
+  return Eigen::Vector3d(v.x, v.y, v.z);
 }
 
-Eigen::Vector3d HEV_to_vec(HEV* v1, HEV* v2) {
-  return Eigen::Vector3d(v2->x - v1->x, v2->y - v1->y, v2->z - v1->z);
+Eigen::Vector3d vertex_to_vec(const vector<Vertex> &vertices, uint32_t v1,
+    uint32_t v2) {
+  const Vertex &a = vertices[v1];
+  const Vertex &b = vertices[v2];
+  return Eigen::Vector3d((double) b.x - a.x, (double) b.y - a.y,
+      (double) b.z - a.z);
 }
 
-Eigen::Vector3d calc_normal(HEF* face) {
-  Eigen::Vector3d v1 = HEV_to_vec(face->edge->vertex);
-  Eigen::Vector3d v2 = HEV_to_vec(face->edge->next->vertex);
-  Eigen::Vector3d v3 = HEV_to_vec(face->edge->next->next->vertex);
+Eigen::Vector3d calc_normal(const HalfedgeMesh &mesh,
+    const vector<Vertex> &vertices, uint32_t face) {
+  uint32_t edge = HalfedgeMesh::face_edge(face);
+  Eigen::Vector3d v1 = vertex_to_vec(vertices, mesh.edges[edge].vertex);
+  Eigen::Vector3d v2 = vertex_to_vec(vertices, mesh.edges[edge + 1].vertex);
+  Eigen::Vector3d v3 = vertex_to_vec(vertices, mesh.edges[edge + 2].vertex);
 
   return (v2 - v1).cross(v3 - v1);
 }
@@ -220,16 +520,21 @@ double calc_area(Eigen::Vector3d normal) {
   return normal.norm();
 }
 
-Normal calc_vertex_normal(HEV *vertex) {
+Normal calc_vertex_normal(const HalfedgeMesh &mesh,
+    const vector<Vertex> &vertices, uint32_t vertex) {
   float x = 0;
   float y = 0;
   float z = 0;
 
-  HE *he = vertex->out; // get outgoing halfedge from given vertex
+  uint32_t out = mesh.out[vertex]; // get outgoing halfedge from given vertex
+  uint32_t he = out;
 
-  do {
+  // a vertex no face uses has no normal, a walk around a boundary vertex
+  // starts at one end of its fan (see out) and stops at the other
+  while (he != NO_HALFEDGE) {
     // compute the normal of the plane of the face
-    Eigen::Vector3d face_normal = calc_normal(he->face);
+    Eigen::Vector3d face_normal = calc_normal(mesh, vertices,
+        HalfedgeMesh::face(he));
     // compute the area of the triangular face
     double face_area = calc_area(face_normal);
 
@@ -239,9 +544,51 @@ Normal calc_vertex_normal(HEV *vertex) {
     z += face_normal(2) * face_area;
 
     // gives us the halfedge to the next adjacent vertex
-    he = he->flip->next;
+    he = mesh.next_around(he);
+    if (he == out) {
+      break;
+    }
   }
-  while(he != vertex->out);
 
   return Normal(x, y, z);
 }
+
+template<typename Index>
+void calc_vertex_normals(const vector<Vertex> &vertices, const Index *corners,
+    size_t num_indices, vector<Normal> &normals) {
+  // Same sums as calc_vertex_normal, made face by face instead of walking
+  // around each vertex
+  vector<Vertex> sums(vertices.size());
+
+  for (size_t i = 0; i + 2 < num_indices; i += 3) {
+    const Vertex &a = vertices[corners[i]];
+    const Vertex &b = vertices[corners[i + 1]];
+    const Vertex &c = vertices[corners[i + 2]];
+    Eigen::Vector3d v1(a.x, a.y, a.z);
+    Eigen::Vector3d v2(b.x, b.y, b.z);
+    Eigen::Vector3d v3(c.x, c.y, c.z);
+
+    // compute the normal of the plane of the face
+    Eigen::Vector3d face_normal = (v2 - v1).cross(v3 - v1);
+    // weight it by the area of the face
+    Eigen::Vector3d weighted = face_normal * calc_area(face_normal);
+
+    for (size_t k = i; k < i + 3; ++k) {
+      Vertex &sum = sums[corners[k]];
+      sum.x += weighted(0);
+      sum.y += weighted(1);
+      sum.z += weighted(2);
+    }
+  }
+
+  normals.clear();
+  normals.reserve(sums.size());
+  for (size_t i = 0; i < sums.size(); ++i) {
+    normals.push_back(Normal(sums[i].x, sums[i].y, sums[i].z));
+  }
+}
+
+template void calc_vertex_normals<uint16_t>(const vector<Vertex> &,
+    const uint16_t *, size_t, vector<Normal> &);
+template void calc_vertex_normals<uint32_t>(const vector<Vertex> &,
+    const uint32_t *, size_t, vector<Normal> &);
@@ -5,7 +5,8 @@
 
 #include <algorithm>
 #include <cassert>
-#include <map>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <utility>
 #include <vector>
@@ -18,55 +19,124 @@ using namespace std;
 
  /* Halfedge structs */
 
-struct HE { // HE for halfedge
-  struct HEV *vertex;
-  // the face adjacent to this halfedge
-  struct HEF *face;
-  struct HE *flip, *next;
-};
+// Stands for no halfedge: the flip of a boundary edge, the out of a vertex
+// no face uses
+const uint32_t NO_HALFEDGE = UINT32_MAX;
 
-struct HEF { // HEF for halfedge face
-  struct HE *edge;
-  // this variable is used to help orientate the halfedge when building it;
-  bool oriented;
+struct HE { // HE for halfedge
+  // the vertex this halfedge leaves from
+  uint32_t vertex;
+  // the halfedge going the other way along the same edge
+  uint32_t flip;
 };
 
-struct HEV { // HEV for halfedge vertex
-  double x, y, z;
-  struct HE *out;
-  // use this to store your index for this vertex when you index the vertices
-  // before building the operator for implicit fairing
-  int index;
+/* A triangle mesh as halfedges in one contiguous array.
+ *
+ * The halfedges of face f are 3f, 3f + 1 and 3f + 2, in order around the
+ * face, so next, prev and face follow from the index and only vertex and
+ * flip are stored: 8 bytes a halfedge and 4 a vertex, with no allocation
+ * per element. Vertices are numbered as in the model (1-based, 0 is the
+ * filler), which also gives positions: they are read from the model's
+ * vertices rather than copied.
+ */
+class HalfedgeMesh {
+  public:
+    vector<HE> edges;
+    // an outgoing halfedge of every vertex, on an open boundary the first
+    // one around (the edge before it is a boundary edge), so that walking
+    // with next_around from it reaches every face of the vertex
+    vector<uint32_t> out;
+
+    // Connected components of the faces (joined by flips), in order of
+    // their first face, which the component is oriented like. The faces of
+    // component c, in order, are component_faces[component_start[c]] up to
+    // component_faces[component_start[c + 1]]. Components share no faces
+    // or halfedges, so face and halfedge work can be split by component.
+    // They can share vertices though (shells that only touch at a vertex),
+    // so per vertex work split this way has to expect other threads on the
+    // same vertex.
+    vector<uint32_t> component_start;
+    vector<uint32_t> component_faces;
+
+    size_t num_faces() const {
+      return edges.size() / 3;
+    }
+
+    size_t num_vertices() const {
+      return out.size();
+    }
+
+    size_t num_components() const {
+      return component_start.empty() ? 0 : component_start.size() - 1;
+    }
+
+    // Bytes held by the arrays
+    size_t memory_bytes() const {
+      return edges.capacity() * sizeof(HE)
+        + (out.capacity() + component_start.capacity()
+            + component_faces.capacity()) * sizeof(uint32_t);
+    }
+
+    static uint32_t next(uint32_t he) {
+      return (he % 3 == 2) ? he - 2 : he + 1;
+    }
+
+    static uint32_t prev(uint32_t he) {
+      return (he % 3 == 0) ? he + 2 : he - 1;
+    }
+
+    static uint32_t face(uint32_t he) {
+      return he / 3;
+    }
+
+    // The first halfedge of a face
+    static uint32_t face_edge(uint32_t face) {
+      return 3 * face;
+    }
+
+    // The next halfedge out of the same vertex, or NO_HALFEDGE on reaching
+    // a boundary. A walk from out that ends on a boundary has not gone
+    // along the boundary edge before out, to edges[prev(out)].vertex.
+    uint32_t next_around(uint32_t he) const {
+      uint32_t flip = edges[he].flip;
+      return (flip == NO_HALFEDGE) ? NO_HALFEDGE : next(flip);
+    }
 };
 
 /* Function prototypes */
 
-pair<int, int> get_edge_key(int x, int y);
-void hash_edge(map<pair<int, int>, HE*> &edge_hash,
-    pair<int, int> edge_key,
-    HE *edge);
-
-bool check_flip(HE *edge);
-bool check_edge(HE *edge);
-bool check_face(HEF *face);
-
-bool orient_flip_face(HE *edge);
-bool orient_face(HEF *face);
-
-// Populate and delete halfedge vectors
-bool build_HE(Mesh_Data *mesh, vector<HEV *> *hevs, vector<HEF *> *hefs);
-void delete_HE(vector<HEV*> *hevs, vector<HEF*> *hefs);
+// Fill mesh from faces over num_vertices vertices (filler included) and
+// orient each of its components. Returns whether every component could be
+// oriented consistently. Throws if a face refers to a missing vertex.
+bool build_HE(const vector<Face> &faces, size_t num_vertices,
+    HalfedgeMesh &mesh);
+// Same from num_faces triangles of 3 corners each (1-based, as Face), for
+// Index uint16_t or uint32_t. Halfedges come out in the order of the
+// corners.
+template<typename Index>
+bool build_HE(const Index *corners, size_t num_faces, size_t num_vertices,
+    HalfedgeMesh &mesh);
 
 // Convert to vectors
-Eigen::Vector3d HEV_to_vec(HEV* vertex);
-Eigen::Vector3d HEV_to_vec(HEV* v1, HEV* v2);
+Eigen::Vector3d vertex_to_vec(const vector<Vertex> &vertices, uint32_t vertex);
+Eigen::Vector3d vertex_to_vec(const vector<Vertex> &vertices, uint32_t v1,
+    uint32_t v2);
 
 // Calculate the normal and use the normal to calculate area
-Eigen::Vector3d calc_normal(HEF* face);
+Eigen::Vector3d calc_normal(const HalfedgeMesh &mesh,
+    const vector<Vertex> &vertices, uint32_t face);
 // area = norm of normal
 double calc_area(Eigen::Vector3d normal);
 
 // Calculate the normal of the vertex based on the halfedge
-Normal calc_vertex_normal(HEV *vertex);
+Normal calc_vertex_normal(const HalfedgeMesh &mesh,
+    const vector<Vertex> &vertices, uint32_t vertex);
+
+// The normal calc_vertex_normal gives for every vertex at once (filler
+// included), straight from num_indices oriented triangle corners. Vertices
+// on an open boundary get the faces they do have.
+template<typename Index>
+void calc_vertex_normals(const vector<Vertex> &vertices, const Index *corners,
+    size_t num_indices, vector<Normal> &normals);
 
 #endif
@@ -1,6 +1,8 @@
 #include "implicit_fairing.hpp"
 
+#include <cstdint>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 #include "halfedge.hpp"
@@ -12,30 +14,30 @@
 
 using namespace std;
 
-// function to assign each vertex in our mesh to an index
-void index_vertices(vector<HEV *> *vertices) {
-	// start at 1 because obj files are 1-indexed
-	for(int i = 1; i < vertices->size(); ++i) {
-		vertices->at(i)->index = i; // assign each vertex an index
-	}
-}
-
 // Return cot(alpha_j) + cot(beta_j) using:
 // cot = cos / sin = A dot B / |A cross B|
-double cot_alpha_beta(HE *he) {
-  HEV *hev1 = he->vertex;
-  HEV *hev2 = he->next->vertex;
-  HEV *hev3 = he->next->next->vertex;
-  HEV *hev4 = he->flip->next->next->vertex;
+double cot_alpha_beta(const HalfedgeMesh &mesh, const vector<Vertex> &vertices,
+    uint32_t he) {
+  uint32_t v1 = mesh.edges[he].vertex;
+  uint32_t v2 = mesh.edges[HalfedgeMesh::next(he)].vertex;
+  uint32_t v3 = mesh.edges[HalfedgeMesh::prev(he)].vertex;
 
-  Eigen::Vector3d alpha_A = HEV_to_vec(hev3, hev1);
-  Eigen::Vector3d alpha_B = HEV_to_vec(hev3, hev2);
-  Eigen::Vector3d beta_A = HEV_to_vec(hev4, hev1);
-  Eigen::Vector3d beta_B = HEV_to_vec(hev4, hev2);
+  Eigen::Vector3d alpha_A = vertex_to_vec(vertices, v3, v1);
+  Eigen::Vector3d alpha_B = vertex_to_vec(vertices, v3, v2);
 
   double cot_alpha_denom = (alpha_A.cross(alpha_B)).norm();
   double cot_alpha = alpha_A.dot(alpha_B) / cot_alpha_denom;
 
+  // a boundary edge has no face on the other side
+  uint32_t flip = mesh.edges[he].flip;
+  if (flip == NO_HALFEDGE) {
+    return cot_alpha;
+  }
+  uint32_t v4 = mesh.edges[HalfedgeMesh::prev(flip)].vertex;
+
+  Eigen::Vector3d beta_A = vertex_to_vec(vertices, v4, v1);
+  Eigen::Vector3d beta_B = vertex_to_vec(vertices, v4, v2);
+
   double cot_beta_denom = (beta_A.cross(beta_B)).norm();
   double cot_beta = beta_A.dot(beta_B) / cot_beta_denom;
 
@@ -54,12 +56,10 @@ double cot_alpha_beta(HE *he) {
  * While multiplying the Laplacian terms by (1/2A) we also
  * multiply by -h and add 1 to the diagonal terms
  */
-Eigen::SparseMatrix<double> build_F_operator(vector<HEV *> *vertices,
-    double time_step) {
-  index_vertices(vertices); // assign each vertex an index
-
+Eigen::SparseMatrix<double> build_F_operator(const HalfedgeMesh &mesh,
+    const vector<Vertex> &vertices, double time_step) {
   // recall due to 1-indexing of obj files, index 0 doesn't contain a vertex
-  int num_vertices = vertices->size() - 1;
+  int num_vertices = mesh.num_vertices() - 1;
 
   // initialize a sparse matrix to represent our F operator
   Eigen::SparseMatrix<double> F(num_vertices, num_vertices);
@@ -67,40 +67,63 @@ Eigen::SparseMatrix<double> build_F_operator(vector<HEV *> *vertices,
   // reserve room for 7 non-zeros per row of F
   F.reserve(Eigen::VectorXi::Constant(num_vertices, 7));
 
-  for (int i = 1; i < vertices->size(); ++i) {
-    HE *he = vertices->at(i)->out;
+  // (j, cot(alpha_j) + cot(beta_j)) for the neighbors of one vertex
+  vector<pair<int, double> > neighbors;
+
+  for (int i = 1; i <= num_vertices; ++i) {
+    uint32_t out = mesh.out[i];
+    // a vertex no face uses stays where it is
+    if (out == NO_HALFEDGE) {
+      F.insert(i-1, i-1) = 1.0;
+      continue;
+    }
+
+    uint32_t he = out;
     double neighbor_area = 0;
     double cot_i = 0;
+    neighbors.clear();
 
-    // iterate over all vertices adjacent to v_i
+    // iterate over all vertices adjacent to v_i, up to a boundary if there
+    // is one
     do {
-      Eigen::Vector3d face_normal = calc_normal(he->face);
+      Eigen::Vector3d face_normal = calc_normal(mesh, vertices,
+          HalfedgeMesh::face(he));
       double face_area = calc_area(face_normal);
       neighbor_area += face_area;
       // get index of adjacent vertex to v_i
-      int j = he->next->vertex->index;
+      int j = mesh.edges[HalfedgeMesh::next(he)].vertex;
 
       // call function to compute cot(alpha_j) + cot(beta_j)
-      double cot_j = cot_alpha_beta(he);
+      double cot_j = cot_alpha_beta(mesh, vertices, he);
       cot_i += cot_j;
+      neighbors.push_back(make_pair(j, cot_j));
 
-      // fill the j-th slot of row i of our Laplacian with appropriate value
-      F.insert(i-1, j-1) = cot_j;
-
-      he = he->flip->next;
+      he = mesh.next_around(he);
+    }
+    while(he != out && he != NO_HALFEDGE);
+
+    // a walk that stopped at a boundary started at the other boundary edge
+    // (see HalfedgeMesh::out), whose far end it has not reached; that edge
+    // only has the cot(alpha) of its one face
+    if (he == NO_HALFEDGE) {
+      uint32_t back = HalfedgeMesh::prev(out);
+      double cot_j = cot_alpha_beta(mesh, vertices, back);
+      cot_i += cot_j;
+      neighbors.push_back(make_pair(mesh.edges[back].vertex, cot_j));
     }
-    while(he != vertices->at(i)->out);
 
+    // fill the j-th slot of row i of our Laplacian with appropriate value,
+    // multiplied by -h/(2A)
     if (neighbor_area > EPSILON) {
       F.insert(i-1, i-1) = 1.0 + time_step/2.0/neighbor_area*cot_i;
-      do {
-        // get index of adjacent vertex to v_i
-        int j = he->next->vertex->index;
-        // multiply by -h/(2A)
-        F.coeffRef(i-1, j-1) *= -1.0*time_step/2.0/neighbor_area;
-        he = he->flip->next;
+      for (size_t k = 0; k < neighbors.size(); ++k) {
+        F.insert(i-1, neighbors[k].first-1) =
+          neighbors[k].second * (-1.0*time_step/2.0/neighbor_area);
+      }
+    } else {
+      for (size_t k = 0; k < neighbors.size(); ++k) {
+        F.insert(i-1, neighbors[k].first-1) = neighbors[k].second;
       }
-      while(he != vertices->at(i)->out);
     }
   }
 
@@ -109,16 +132,16 @@ Eigen::SparseMatrix<double> build_F_operator(vector<HEV *> *vertices,
 }
 
 // Solve for x_h in (I - h Delta) x_h = x_0
-Eigen::VectorXd solve_x(Eigen::SparseMatrix<double> F, Model *model, vector<HEV *> *vertices, double time_step) {
+Eigen::VectorXd solve_x(const Eigen::SparseMatrix<double> &F, Model *model, double time_step) {
   Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int> > solver;
   solver.analyzePattern(F);
   solver.factorize(F);
 
-  int num_vertices = vertices->size() - 1;
+  int num_vertices = model->vertices.size() - 1;
 
   // initialize our vector representation of x_0
   Eigen::VectorXd x_0(num_vertices);
-  for(int i = 1; i < vertices->size(); ++i) {
+  for(int i = 1; i <= num_vertices; ++i) {
     x_0(i-1) = model->vertices.at(i).x;
   }
 
@@ -128,16 +151,16 @@ Eigen::VectorXd solve_x(Eigen::SparseMatrix<double> F, Model *model, vector<HEV
 }
 
 // Solve for y_h in (I - h Delta) y_h = y_0
-Eigen::VectorXd solve_y(Eigen::SparseMatrix<double> F, Model *model, vector<HEV *> *vertices, double time_step) {
+Eigen::VectorXd solve_y(const Eigen::SparseMatrix<double> &F, Model *model, double time_step) {
   Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int> > solver;
   solver.analyzePattern(F);
   solver.factorize(F);
 
-  int num_vertices = vertices->size() - 1;
+  int num_vertices = model->vertices.size() - 1;
 
   // initialize our vector representation of y_0
   Eigen::VectorXd y_0(num_vertices);
-  for(int i = 1; i < vertices->size(); ++i) {
+  for(int i = 1; i <= num_vertices; ++i) {
     y_0(i-1) = model->vertices.at(i).y;
   }
 
@@ -147,16 +170,16 @@ Eigen::VectorXd solve_y(Eigen::SparseMatrix<double> F, Model *model, vector<HEV
 }
 
 // Solve for z_h in (I - h Delta) z_h = z_0
-Eigen::VectorXd solve_z(Eigen::SparseMatrix<double> F, Model *model, vector<HEV *> *vertices, double time_step) {
+Eigen::VectorXd solve_z(const Eigen::SparseMatrix<double> &F, Model *model, double time_step) {
   Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int> > solver;
   solver.analyzePattern(F);
   solver.factorize(F);
 
-  int num_vertices = vertices->size() - 1;
+  int num_vertices = model->vertices.size() - 1;
 
   // initialize our vector representation of z_0
   Eigen::VectorXd z_0(num_vertices);
-  for(int i = 1; i < vertices->size(); ++i) {
+  for(int i = 1; i <= num_vertices; ++i) {
     z_0(i-1) = model->vertices.at(i).z;
   }
 
@@ -166,38 +189,34 @@ Eigen::VectorXd solve_z(Eigen::SparseMatrix<double> F, Model *model, vector<HEV
 }
 
 void update_vertices(Model *model, Eigen::VectorXd &xh, Eigen::VectorXd &yh, Eigen::VectorXd &zh) {
-  model->vertex_buffer.clear();
-  model->normal_buffer.clear();
-
   int num_vertices = model->vertices.size();
-  model->setup_vertices();
   for(int i = 1; i < num_vertices; ++i) {
-    model->vertices.push_back(Vertex(xh(i-1), yh(i-1), zh(i-1)));
+    model->vertices[i] = Vertex(xh(i-1), yh(i-1), zh(i-1));
   }
-  model->set_variables();
+  // Only positions changed, the halfedges still hold
+  model->update_positions();
 }
 
 void implicit_fairing(vector<Model> &objects, double time_step) {
   for (vector<Model>::iterator obj_it = objects.begin(); obj_it != objects.end(); ++obj_it) {
     Model *model = &(*obj_it);
+    // Copies that are not loaded right now (-lazy) have nothing to smooth
+    if (model->faces.empty()) {
+      continue;
+    }
 
-    Mesh_Data *mesh_data = new Mesh_Data;
-    mesh_data->vertices = &(model->vertices);
-    mesh_data->faces = &(model->faces);
-
-    vector<HEV *> *hevs = new vector<HEV *>();
-    vector<HEF *> *hefs = new vector<HEF *>();
-    build_HE(mesh_data, hevs, hefs);
+    if (!model->halfedges_current()) {
+      model->set_variables();
+    }
 
-    Eigen::SparseMatrix<double> F = build_F_operator(hevs, time_step);
+    Eigen::SparseMatrix<double> F = build_F_operator(*model->halfedges,
+        model->vertices, time_step);
 
     // Calculate new vertices
-    Eigen::VectorXd xh = solve_x(F, model, hevs, time_step);
-    Eigen::VectorXd yh = solve_y(F, model, hevs, time_step);
-    Eigen::VectorXd zh = solve_z(F, model, hevs, time_step);
+    Eigen::VectorXd xh = solve_x(F, model, time_step);
+    Eigen::VectorXd yh = solve_y(F, model, time_step);
+    Eigen::VectorXd zh = solve_z(F, model, time_step);
 
     update_vertices(model, xh, yh, zh);
-    delete mesh_data;
-    delete_HE(hevs, hefs);
   }
 }
@@ -1,6 +1,7 @@
 #ifndef IMPLICIT_FAIRING_HPP
 #define IMPLICIT_FAIRING_HPP
 
+#include <cstdint>
 #include <vector>
 
 #include "halfedge.hpp"
@@ -14,12 +15,11 @@ using namespace std;
 
 const double EPSILON = 0.000001;
 
-// function to assign each vertex in our mesh to an index
-void index_vertices(vector<HEV *> *vertices);
-
 // Return cot(alpha_j) + cot(beta_j) using:
 // cot = cos / sin = A dot B / |A cross B|
-double cot_alpha_beta(HE *he);
+// (only cot(alpha_j) on a boundary edge)
+double cot_alpha_beta(const HalfedgeMesh &mesh, const vector<Vertex> &vertices,
+    uint32_t he);
 
 /* Function to construct our Laplacian operator in matrix form:
  * We separate the x_i and x_j terms to get,
@@ -33,18 +33,20 @@ double cot_alpha_beta(HE *he);
  * While multiplying the Laplacian terms by (1/2A) we also
  * multiply by -h and add 1 to the diagonal terms to get the F
  * operator as a matrix.
+ *
+ * Row and column i - 1 are vertex i, the filler has none.
  */
-Eigen::SparseMatrix<double> build_F_operator(vector<HEV *> *vertices,
-    double time_step);
+Eigen::SparseMatrix<double> build_F_operator(const HalfedgeMesh &mesh,
+    const vector<Vertex> &vertices, double time_step);
 
 // Solve for x_h in (I - h Delta) x_h = x_0
-Eigen::VectorXd solve_x(Eigen::SparseMatrix<double> F, Model *model, vector<HEV *> *vertices, double time_step);
+Eigen::VectorXd solve_x(const Eigen::SparseMatrix<double> &F, Model *model, double time_step);
 
 // Solve for y_h in (I - h Delta) y_h = y_0
-Eigen::VectorXd solve_y(Eigen::SparseMatrix<double> F, Model *model, vector<HEV *> *vertices, double time_step);
+Eigen::VectorXd solve_y(const Eigen::SparseMatrix<double> &F, Model *model, double time_step);
 
 // Solve for z_h in (I - h Delta) z_h = z_0
-Eigen::VectorXd solve_z(Eigen::SparseMatrix<double> F, Model *model, vector<HEV *> *vertices, double time_step);
+Eigen::VectorXd solve_z(const Eigen::SparseMatrix<double> &F, Model *model, double time_step);
 
 // Update vertices (x_0, y_0, z_0) -> (x_h, y_h, z_h)
 void update_vertices(Model *model, Eigen::VectorXd &xh, Eigen::VectorXd &yh, Eigen::VectorXd &zh);
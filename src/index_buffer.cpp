@@ -0,0 +1,45 @@
+#include "index_buffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+IndexBuffer :: IndexBuffer() : short_indices(true) {
+}
+
+void IndexBuffer :: reset(size_t num_vertices, size_t num_indices) {
+  clear();
+  short_indices = num_vertices <= SHORT_INDEX_LIMIT;
+  if (short_indices) {
+    indices16.resize(num_indices);
+  } else {
+    indices32.resize(num_indices);
+  }
+}
+
+void IndexBuffer :: clear() {
+  // Give the memory back, a reload may pick the other width
+  vector<uint16_t>().swap(indices16);
+  vector<uint32_t>().swap(indices32);
+  short_indices = true;
+}
+
+bool IndexBuffer :: is_short() const {
+  return short_indices;
+}
+
+size_t IndexBuffer :: size() const {
+  return short_indices ? indices16.size() : indices32.size();
+}
+
+size_t IndexBuffer :: bytes() const {
+  return short_indices ? indices16.size() * sizeof(uint16_t)
+    : indices32.size() * sizeof(uint32_t);
+}
+
+const void *IndexBuffer :: data() const {
+  return short_indices ? static_cast<const void *>(indices16.data())
+    : static_cast<const void *>(indices32.data());
+}
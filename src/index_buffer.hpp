@@ -0,0 +1,66 @@
+#ifndef INDEX_BUFFER_HPP
+#define INDEX_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/* Triangle corners of a mesh for glDrawElements.
+ *
+ * Indices are 16 bit when every vertex of the mesh fits (most of our
+ * meshes have well under 65536) and 32 bit otherwise, which halves index
+ * memory and bandwidth for small meshes. Code that fills or reads the
+ * corners is a template on the index type; callers check is_short once
+ * per mesh and call the matching instantiation with get<Index>.
+ */
+
+// Largest vertex count (filler at index 0 included) for 16 bit indices
+const size_t SHORT_INDEX_LIMIT = size_t(1) << 16;
+
+class IndexBuffer {
+  public:
+    IndexBuffer();
+
+    // Make room for num_indices corners, wide enough for num_vertices
+    void reset(size_t num_vertices, size_t num_indices);
+    void clear();
+
+    bool is_short() const;
+    size_t size() const;
+    size_t bytes() const;
+    // First corner, whatever the width
+    const void *data() const;
+
+    // Corners as Index (uint16_t or uint32_t, must match is_short)
+    template<typename Index> Index *get();
+    template<typename Index> const Index *get() const;
+
+  private:
+    bool short_indices;
+    vector<uint16_t> indices16;
+    vector<uint32_t> indices32;
+};
+
+template<>
+inline uint16_t *IndexBuffer :: get<uint16_t>() {
+  return indices16.data();
+}
+
+template<>
+inline const uint16_t *IndexBuffer :: get<uint16_t>() const {
+  return indices16.data();
+}
+
+template<>
+inline uint32_t *IndexBuffer :: get<uint32_t>() {
+  return indices32.data();
+}
+
+template<>
+inline const uint32_t *IndexBuffer :: get<uint32_t>() const {
+  return indices32.data();
+}
+
+#endif
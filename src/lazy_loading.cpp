@@ -0,0 +1,115 @@
+#include "lazy_loading.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "structs.hpp"
+
+using namespace std;
+
+void multiply_view(const double projection[16], const double modelview[16],
+    double view[16]) {
+  for (int col = 0; col < 4; ++col) {
+    for (int row = 0; row < 4; ++row) {
+      double sum = 0;
+      for (int k = 0; k < 4; ++k) {
+        sum += projection[4 * k + row] * modelview[4 * col + k];
+      }
+      view[4 * col + row] = sum;
+    }
+  }
+}
+
+// One bit for each clip plane (x, y, z against -w and w) the point
+// (x, y, z, 1) is outside of
+static int outside_planes(const double view[16], double x, double y,
+    double z) {
+  double clip[4];
+  for (int row = 0; row < 4; ++row) {
+    clip[row] = view[row] * x + view[4 + row] * y + view[8 + row] * z
+      + view[12 + row];
+  }
+
+  int planes = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (clip[axis] < -clip[3]) {
+      planes |= 1 << (2 * axis);
+    }
+    if (clip[axis] > clip[3]) {
+      planes |= 2 << (2 * axis);
+    }
+  }
+  return planes;
+}
+
+bool box_in_view(const double view[16], const Vertex &min_corner,
+    const Vertex &max_corner) {
+  // Planes every corner is outside of
+  int common = 63;
+  for (int corner = 0; corner < 8 && common != 0; ++corner) {
+    common &= outside_planes(view,
+        (corner & 1) ? max_corner.x : min_corner.x,
+        (corner & 2) ? max_corner.y : min_corner.y,
+        (corner & 4) ? max_corner.z : min_corner.z);
+  }
+  return common == 0;
+}
+
+ObjectBudget :: ObjectBudget(size_t num_objects, size_t budget_bytes)
+  : budget(budget_bytes), used(0), frame(1), loaded_objects(num_objects),
+    sizes(num_objects), last_used(num_objects) {
+}
+
+void ObjectBudget :: next_frame() {
+  ++frame;
+}
+
+void ObjectBudget :: touch(size_t i) {
+  last_used[i] = frame;
+}
+
+void ObjectBudget :: loaded(size_t i, size_t bytes) {
+  if (loaded_objects[i]) {
+    used -= sizes[i];
+  }
+  loaded_objects[i] = true;
+  sizes[i] = bytes;
+  used += bytes;
+  last_used[i] = frame;
+}
+
+bool ObjectBudget :: is_loaded(size_t i) const {
+  return loaded_objects[i];
+}
+
+vector<size_t> ObjectBudget :: evict() {
+  vector<size_t> evicted;
+  if (used <= budget) {
+    return evicted;
+  }
+
+  // (last use, copy) of everything out of view
+  vector<pair<uint64_t, size_t> > candidates;
+  for (size_t i = 0; i < loaded_objects.size(); ++i) {
+    if (loaded_objects[i] && last_used[i] < frame) {
+      candidates.push_back(make_pair(last_used[i], i));
+    }
+  }
+  sort(candidates.begin(), candidates.end());
+
+  for (size_t j = 0; j < candidates.size() && used > budget; ++j) {
+    size_t i = candidates[j].second;
+    used -= sizes[i];
+    sizes[i] = 0;
+    loaded_objects[i] = false;
+    evicted.push_back(i);
+  }
+  return evicted;
+}
+
+size_t ObjectBudget :: used_bytes() const {
+  return used;
+}
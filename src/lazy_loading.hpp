@@ -0,0 +1,64 @@
+#ifndef LAZY_LOADING_HPP
+#define LAZY_LOADING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "structs.hpp"
+
+using namespace std;
+
+/* Bookkeeping for loading copies only when they are needed (-lazy).
+ *
+ * The renderer tests each copy against the view every frame by its
+ * bounding box: before the copy is loaded, the box of its mesh file (from
+ * the cache header, or one streaming pass over an .obj) moved by its
+ * transforms, and the exact box once it has been loaded. A copy whose file
+ * gives no box without loading it counts as in view until loaded once.
+ * Copies in view or asked for get loaded; ObjectBudget then picks which
+ * copies to unload once the loaded ones hold more than the budget.
+ */
+
+// view is projection * modelview, column major as glGetDoublev gives them
+void multiply_view(const double projection[16], const double modelview[16],
+    double view[16]);
+
+// False only if the box is entirely outside one of the clip planes
+bool box_in_view(const double view[16], const Vertex &min_corner,
+    const Vertex &max_corner);
+
+/* Least recently used accounting of loaded copies.
+ *
+ * Copies in view in the current frame are never picked, so a view that
+ * needs more than the budget goes over it rather than reloading every
+ * frame.
+ */
+class ObjectBudget {
+  public:
+    ObjectBudget(size_t num_objects, size_t budget_bytes);
+
+    // Start a new frame, then touch every copy in view
+    void next_frame();
+    void touch(size_t i);
+
+    // Copy i is now loaded and holds bytes (counts as used now)
+    void loaded(size_t i, size_t bytes);
+    bool is_loaded(size_t i) const;
+
+    // Copies to unload, least recently used first, to get back under the
+    // budget. They count as unloaded from now on.
+    vector<size_t> evict();
+
+    size_t used_bytes() const;
+
+  private:
+    size_t budget;
+    size_t used;
+    uint64_t frame;
+    vector<bool> loaded_objects;
+    vector<size_t> sizes;
+    vector<uint64_t> last_used;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef LOAD_OPTIONS_HPP
+#define LOAD_OPTIONS_HPP
+
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+// Orders the vertices and faces of a mesh can be put in after parsing
+// (see reorder)
+enum MeshOrdering {
+  // as in the file
+  ORDER_FILE = 0,
+  // along a Morton curve through the bounding box
+  ORDER_MORTON = 1,
+  // reverse Cuthill-McKee
+  ORDER_RCM = 2
+};
+
+// Name of ordering in tags and on the command line
+inline const char *ordering_name(MeshOrdering ordering) {
+  switch (ordering) {
+    case ORDER_MORTON:
+      return "morton";
+    case ORDER_RCM:
+      return "rcm";
+    default:
+      return "file";
+  }
+}
+
+// How mesh files are turned into Models. Meshes loaded with different
+// options are different meshes: they are shared and cached separately.
+struct MeshLoadOptions {
+  // Merge vertices closer than weld_epsilon after parsing (see weld)
+  bool weld;
+  float weld_epsilon;
+  // Renumber vertices and faces after welding (see reorder)
+  MeshOrdering ordering;
+
+  MeshLoadOptions() : weld(false), weld_epsilon(0), ordering(ORDER_FILE) {}
+
+  // Empty for the defaults, otherwise a short string naming the options
+  // that is safe to put in file names
+  string tag() const {
+    string text;
+    if (weld) {
+      char epsilon[32];
+      snprintf(epsilon, sizeof(epsilon), "weld%.9g", weld_epsilon);
+      text = epsilon;
+    }
+    if (ordering != ORDER_FILE) {
+      text += (text.empty() ? "" : ".") + string(ordering_name(ordering));
+    }
+    return text;
+  }
+};
+
+#endif
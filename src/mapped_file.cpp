@@ -0,0 +1,63 @@
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile :: MappedFile() {
+  begin = NULL;
+  length = 0;
+}
+
+MappedFile :: ~MappedFile() {
+  close();
+}
+
+bool MappedFile :: open(const string &file_name) {
+  close();
+
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  // mmap refuses zero length mappings, an empty file is just an empty view
+  if (file_stat.st_size == 0) {
+    ::close(fd);
+    return true;
+  }
+
+  void *mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  // The parsers walk the file front to back exactly once
+  madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+
+  begin = static_cast<const char *>(mapping);
+  length = file_stat.st_size;
+  return true;
+}
+
+void MappedFile :: close() {
+  if (begin != NULL) {
+    munmap(const_cast<char *>(begin), length);
+  }
+  begin = NULL;
+  length = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Read-only view of a whole file mapped into memory with mmap
+class MappedFile {
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    // Map file_name, returns false if it can not be opened or mapped
+    bool open(const string &file_name);
+    // Unmap the file, safe to call more than once
+    void close();
+
+    const char *data() const { return begin; }
+    const char *end() const { return begin + length; }
+    size_t size() const { return length; }
+
+  private:
+    const char *begin;
+    size_t length;
+
+    // Mappings own a resource so they can not be copied
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "mesh_cache.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory> // shared_ptr
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "load_options.hpp"
+#include "mapped_file.hpp"
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+// The arrays are copied with memcpy, so the structs must be packed floats
+// and ints on a little-endian host
+static_assert(sizeof(Vertex) == 3 * sizeof(float), "Vertex must be 3 floats");
+static_assert(sizeof(Face) == 3 * sizeof(int32_t), "Face must be 3 ints");
+
+static bool is_little_endian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+}
+
+static size_t padded_path_length(size_t length) {
+  return (length + 7) & ~size_t(7);
+}
+
+// Size and modification time of the source, false if it can not be read
+static bool stat_source(const string &source_file, struct stat &source_stat) {
+  return stat(source_file.c_str(), &source_stat) == 0
+    && S_ISREG(source_stat.st_mode);
+}
+
+// True if header (and its source path) describe the cache of source_file
+// as it is now, loaded with options
+static bool header_matches(const MeshCacheHeader &header,
+    const char *header_path, const struct stat &source_stat,
+    const string &source_file, const MeshLoadOptions &options) {
+  return memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0
+    && header.version == MESH_CACHE_VERSION
+    && header.source_size == uint64_t(source_stat.st_size)
+    && header.source_mtime_sec == int64_t(source_stat.st_mtim.tv_sec)
+    && header.source_mtime_nsec == int64_t(source_stat.st_mtim.tv_nsec)
+    && header.path_length == source_file.size()
+    && header.weld == uint32_t(options.weld)
+    && header.weld_epsilon == options.weld_epsilon
+    && header.ordering == uint32_t(options.ordering)
+    && memcmp(header_path, source_file.data(), header.path_length) == 0;
+}
+
+string mesh_cache_file_name(const string &source_file,
+    const MeshLoadOptions &options) {
+  string tag = options.tag();
+  return source_file + (tag.empty() ? "" : "." + tag) + ".cache";
+}
+
+bool load_mesh_cache(const string &source_file, Model &model,
+    const MeshLoadOptions &options) {
+  struct stat source_stat;
+  if (!is_little_endian() || !stat_source(source_file, source_stat)) {
+    return false;
+  }
+
+  MappedFile cache;
+  if (!cache.open(mesh_cache_file_name(source_file, options))
+      || cache.size() < sizeof(MeshCacheHeader)) {
+    return false;
+  }
+
+  MeshCacheHeader header;
+  memcpy(&header, cache.data(), sizeof(header));
+
+  bool reordered = header.ordering != ORDER_FILE;
+  size_t path_offset = sizeof(header);
+  size_t vertex_offset = path_offset + padded_path_length(header.path_length);
+  size_t face_offset = vertex_offset + header.num_vertices * sizeof(Vertex);
+  size_t order_offset = face_offset + header.num_faces * sizeof(Face);
+  size_t expected_size = order_offset + (reordered
+      ? (header.num_vertices + header.num_faces) * sizeof(uint32_t) : 0);
+
+  // (The size check comes first, so the path is there to compare)
+  if (cache.size() != expected_size
+      || !header_matches(header, cache.data() + path_offset, source_stat,
+        source_file, options)) {
+    return false;
+  }
+
+  // Keep the filler vertex at index 0 and copy the rest in one go
+  model.vertices.resize(1);
+  model.vertices.resize(1 + header.num_vertices);
+  memcpy(&model.vertices[1], cache.data() + vertex_offset,
+      header.num_vertices * sizeof(Vertex));
+
+  model.faces.resize(header.num_faces, Face(0, 0, 0));
+  if (header.num_faces > 0) {
+    memcpy(&model.faces[0], cache.data() + face_offset,
+        header.num_faces * sizeof(Face));
+  }
+
+  if (reordered) {
+    shared_ptr<MeshOrder> order(new MeshOrder());
+    order->vertices.resize(1 + header.num_vertices, 0);
+    order->faces.resize(header.num_faces);
+    if (header.num_vertices > 0) {
+      memcpy(&order->vertices[1], cache.data() + order_offset,
+          header.num_vertices * sizeof(uint32_t));
+    }
+    if (header.num_faces > 0) {
+      memcpy(&order->faces[0], cache.data() + order_offset
+          + header.num_vertices * sizeof(uint32_t),
+          header.num_faces * sizeof(uint32_t));
+    }
+    model.original_order = order;
+  } else {
+    model.original_order.reset();
+  }
+
+  return true;
+}
+
+bool load_mesh_cache_bounds(const string &source_file, Vertex &min_corner,
+    Vertex &max_corner, const MeshLoadOptions &options) {
+  struct stat source_stat;
+  if (!is_little_endian() || !stat_source(source_file, source_stat)) {
+    return false;
+  }
+
+  // Only the header and path are read, not the arrays after them
+  FILE *in = fopen(mesh_cache_file_name(source_file, options).c_str(), "rb");
+  if (in == NULL) {
+    return false;
+  }
+  MeshCacheHeader header;
+  vector<char> path(source_file.size());
+  bool ok = fread(&header, sizeof(header), 1, in) == 1
+    && header.path_length == source_file.size()
+    && fread(path.data(), 1, path.size(), in) == path.size()
+    && header_matches(header, path.data(), source_stat, source_file, options);
+  fclose(in);
+  if (!ok) {
+    return false;
+  }
+
+  min_corner.set_vertex(header.min_corner[0], header.min_corner[1],
+      header.min_corner[2]);
+  max_corner.set_vertex(header.max_corner[0], header.max_corner[1],
+      header.max_corner[2]);
+  return true;
+}
+
+bool save_mesh_cache(const string &source_file, const Model &model,
+    const MeshLoadOptions &options) {
+  struct stat source_stat;
+  if (!is_little_endian() || !stat_source(source_file, source_stat)) {
+    return false;
+  }
+
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  header.path_length = source_file.size();
+  header.source_size = source_stat.st_size;
+  header.source_mtime_sec = source_stat.st_mtim.tv_sec;
+  header.source_mtime_nsec = source_stat.st_mtim.tv_nsec;
+  header.num_vertices = model.vertices.empty() ? 0 : model.vertices.size() - 1;
+  header.num_faces = model.faces.size();
+  header.weld = options.weld;
+  header.weld_epsilon = options.weld_epsilon;
+  header.ordering = options.ordering;
+
+  Vertex min_corner, max_corner;
+  model.get_bounds(min_corner, max_corner);
+  header.min_corner[0] = min_corner.x;
+  header.min_corner[1] = min_corner.y;
+  header.min_corner[2] = min_corner.z;
+  header.max_corner[0] = max_corner.x;
+  header.max_corner[1] = max_corner.y;
+  header.max_corner[2] = max_corner.z;
+
+  // A reordered mesh has to come back with the way to its file order
+  const MeshOrder *order = model.original_order.get();
+  if (options.ordering != ORDER_FILE && (order == NULL
+        || order->vertices.size() != header.num_vertices + 1
+        || order->faces.size() != header.num_faces)) {
+    return false;
+  }
+
+  // Write to a temporary and rename so readers never see a partial cache
+  string cache_file = mesh_cache_file_name(source_file, options);
+  string temp_file = cache_file + ".tmp" + to_string(getpid());
+
+  FILE *out = fopen(temp_file.c_str(), "wb");
+  if (out == NULL) {
+    return false;
+  }
+
+  vector<char> path(padded_path_length(source_file.size()), '\0');
+  memcpy(path.data(), source_file.data(), source_file.size());
+
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+    && fwrite(path.data(), 1, path.size(), out) == path.size()
+    && fwrite(model.vertices.data() + 1, sizeof(Vertex), header.num_vertices,
+        out) == header.num_vertices
+    && fwrite(model.faces.data(), sizeof(Face), header.num_faces,
+        out) == header.num_faces;
+  if (options.ordering != ORDER_FILE) {
+    ok = ok && fwrite(order->vertices.data() + 1, sizeof(uint32_t),
+        header.num_vertices, out) == header.num_vertices
+      && fwrite(order->faces.data(), sizeof(uint32_t), header.num_faces,
+          out) == header.num_faces;
+  }
+
+  ok = (fclose(out) == 0) && ok;
+  if (!ok || rename(temp_file.c_str(), cache_file.c_str()) != 0) {
+    remove(temp_file.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,74 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "load_options.hpp"
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+/* Binary cache of parsed meshes.
+ *
+ * A parsed .obj is saved next to the source as <file>.cache (or
+ * <file>.<tag>.cache when loaded with non-default MeshLoadOptions). The
+ * header records the source path, size and modification time and the load
+ * options; when they still match, the cache is mapped and its flat
+ * little-endian vertex and face arrays are copied straight into the model
+ * instead of parsing text (or reordering it).
+ *
+ * Layout (all fields little-endian):
+ *   MeshCacheHeader
+ *   source path (path_length bytes, zero padded to a multiple of 8)
+ *   num_vertices * 3 float   (x y z, vertex 0 filler not stored)
+ *   num_faces * 3 int32      (1-based vertex indices)
+ * and for reordered meshes (see Model::original_order)
+ *   num_vertices * uint32    (file index of each vertex, filler not stored)
+ *   num_faces * uint32       (file index of each face)
+ */
+
+const char MESH_CACHE_MAGIC[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+// Bump whenever the parser changes what it produces for the same file
+const uint32_t MESH_CACHE_VERSION = 4;
+
+struct MeshCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t path_length;
+  uint64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  uint64_t num_vertices;
+  uint64_t num_faces;
+  // MeshLoadOptions the mesh was loaded with
+  uint32_t weld;
+  float weld_epsilon;
+  // a MeshOrdering
+  uint32_t ordering;
+  uint32_t unused;
+  // Bounding box of the vertices (all zero if there are none), readable
+  // without mapping the arrays
+  float min_corner[3];
+  float max_corner[3];
+};
+
+// Name of the cache file kept for source_file
+string mesh_cache_file_name(const string &source_file,
+    const MeshLoadOptions &options = MeshLoadOptions());
+
+// Fill model from the cache of source_file, false if it is missing or stale
+bool load_mesh_cache(const string &source_file, Model &model,
+    const MeshLoadOptions &options = MeshLoadOptions());
+
+// Bounding box of source_file from the header of its cache alone, false if
+// the cache is missing or stale
+bool load_mesh_cache_bounds(const string &source_file, Vertex &min_corner,
+    Vertex &max_corner, const MeshLoadOptions &options = MeshLoadOptions());
+
+// Write model as the cache of source_file, false if it could not be written
+bool save_mesh_cache(const string &source_file, const Model &model,
+    const MeshLoadOptions &options = MeshLoadOptions());
+
+#endif
@@ -0,0 +1,108 @@
+#include "mesh_library.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <string>
+
+#include "load_options.hpp"
+#include "model.hpp"
+#include "parser.hpp"
+
+using namespace std;
+
+// Meshes stay in the table only while someone holds them
+static map<string, weak_ptr<const Model>> loaded_meshes;
+// Meshes some thread is parsing right now, with the promise it will fill
+struct PendingMesh {
+  shared_future<MeshPtr> result;
+  const promise<MeshPtr> *owner;
+};
+static map<string, PendingMesh> pending_meshes;
+static mutex library_mutex;
+
+string canonical_mesh_path(const string &file_name) {
+  char resolved[PATH_MAX];
+  if (realpath(file_name.c_str(), resolved) == NULL) {
+    // Missing files still get one (empty) shared mesh per name
+    return file_name;
+  }
+  return string(resolved);
+}
+
+// Welded and unwelded loads of one file are different meshes
+static string mesh_key(const string &file_name, const MeshLoadOptions &options) {
+  return canonical_mesh_path(file_name) + "\n" + options.tag();
+}
+
+// Remove the pending entry for key if it is still the one parsed fills,
+// false if forget_shared_mesh dropped it. Called with library_mutex held.
+static bool finish_pending(const string &key, const promise<MeshPtr> &parsed) {
+  map<string, PendingMesh>::iterator pending = pending_meshes.find(key);
+  if (pending == pending_meshes.end() || pending->second.owner != &parsed) {
+    return false;
+  }
+  pending_meshes.erase(pending);
+  return true;
+}
+
+void forget_shared_mesh(const string &file_name,
+    const MeshLoadOptions &options) {
+  string key = mesh_key(file_name, options);
+
+  // A parse already under way finishes and is handed to its waiters, but
+  // it is not reused afterwards either
+  lock_guard<mutex> lock(library_mutex);
+  loaded_meshes.erase(key);
+  pending_meshes.erase(key);
+}
+
+MeshPtr get_shared_mesh(const string &file_name,
+    const MeshLoadOptions &options) {
+  string key = mesh_key(file_name, options);
+  promise<MeshPtr> parsed;
+
+  unique_lock<mutex> lock(library_mutex);
+
+  MeshPtr mesh = loaded_meshes[key].lock();
+  if (mesh) {
+    return mesh;
+  }
+
+  map<string, PendingMesh>::iterator pending = pending_meshes.find(key);
+  if (pending != pending_meshes.end()) {
+    shared_future<MeshPtr> result = pending->second.result;
+    lock.unlock();
+    return result.get();
+  }
+
+  PendingMesh entry = { parsed.get_future().share(), &parsed };
+  pending_meshes[key] = entry;
+  lock.unlock();
+
+  // Parse outside the lock so other files load at the same time
+  try {
+    shared_ptr<Model> parsed(new Model(parse_file_to_model(file_name,
+          options)));
+    // Once here rather than once per copy, the copies share them
+    parsed->build_halfedges();
+    mesh = parsed;
+  } catch (...) {
+    lock.lock();
+    finish_pending(key, parsed);
+    parsed.set_exception(current_exception());
+    throw;
+  }
+
+  lock.lock();
+  // Unless the file was forgotten meanwhile, the result is now the mesh
+  if (finish_pending(key, parsed)) {
+    loaded_meshes[key] = mesh;
+  }
+  parsed.set_value(mesh);
+  return mesh;
+}
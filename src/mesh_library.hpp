@@ -0,0 +1,37 @@
+#ifndef MESH_LIBRARY_HPP
+#define MESH_LIBRARY_HPP
+
+#include <memory> // shared_ptr
+#include <string>
+
+#include "load_options.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+// Parsed mesh shared read-only between everything that uses the file
+using MeshPtr = shared_ptr<const Model>;
+
+/* Process wide table of parsed meshes keyed by canonical path and load
+ * options.
+ *
+ * Every name that resolves to the same file (relative paths, "./", symlinks)
+ * gets the same MeshPtr, so the file is parsed once and held in memory once
+ * for as long as someone uses it. Safe to call from several threads; a
+ * second caller asking for a file that is still being parsed waits for the
+ * first instead of parsing it again.
+ */
+
+// Shared mesh for file_name, parsing it if nobody holds it right now
+MeshPtr get_shared_mesh(const string &file_name,
+    const MeshLoadOptions &options = MeshLoadOptions());
+
+// Drop the table entry for file_name (after it changed on disk) so the next
+// get_shared_mesh parses it again. Meshes already handed out stay valid.
+void forget_shared_mesh(const string &file_name,
+    const MeshLoadOptions &options = MeshLoadOptions());
+
+// Canonical form of file_name used as the table key
+string canonical_mesh_path(const string &file_name);
+
+#endif
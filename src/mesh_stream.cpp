@@ -0,0 +1,175 @@
+#include "mesh_stream.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gzip_input.hpp"
+#include "model.hpp"
+#include "obj_parser.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+ObjStreamParser :: ObjStreamParser(MeshSink &sink, size_t batch_size)
+  : sink(sink), batch_size(batch_size) {
+  vertex_batch.reserve(batch_size);
+  face_batch.reserve(batch_size);
+}
+
+void ObjStreamParser :: feed(const char *data, size_t size) {
+  const char *p = data;
+  const char *end = data + size;
+
+  // Finish the line left over from the previous piece first
+  if (!partial_line.empty()) {
+    const char *line_end = find_line_end(p, end);
+    partial_line.append(p, line_end);
+    if (line_end == end) {
+      return;
+    }
+
+    parse_line(partial_line.data(), partial_line.data() + partial_line.size());
+    partial_line.clear();
+    p = line_end + 1;
+  }
+
+  while (p < end) {
+    const char *line_end = find_line_end(p, end);
+    if (line_end == end) {
+      partial_line.assign(p, end);
+      return;
+    }
+
+    parse_line(p, line_end);
+    p = line_end + 1;
+  }
+}
+
+void ObjStreamParser :: finish() {
+  if (!partial_line.empty()) {
+    parse_line(partial_line.data(), partial_line.data() + partial_line.size());
+    partial_line.clear();
+  }
+
+  flush_faces();
+  flush_vertices();
+}
+
+void ObjStreamParser :: parse_line(const char *begin, const char *line_end) {
+  parse_obj_line(begin, line_end, vertex_batch, face_batch, state);
+
+  if (vertex_batch.size() >= batch_size) {
+    flush_vertices();
+  }
+  if (face_batch.size() >= batch_size) {
+    flush_faces();
+  }
+}
+
+void ObjStreamParser :: flush_vertices() {
+  if (!vertex_batch.empty()) {
+    sink.add_vertices(vertex_batch.data(), vertex_batch.size());
+    vertex_batch.clear();
+  }
+}
+
+void ObjStreamParser :: flush_faces() {
+  // Faces may use any vertex read so far
+  flush_vertices();
+
+  if (!face_batch.empty()) {
+    sink.add_faces(face_batch.data(), face_batch.size());
+    face_batch.clear();
+  }
+}
+
+void ModelSink :: add_vertices(const Vertex *vertices, size_t count) {
+  model.vertices.insert(model.vertices.end(), vertices, vertices + count);
+}
+
+void ModelSink :: add_faces(const Face *faces, size_t count) {
+  model.faces.insert(model.faces.end(), faces, faces + count);
+}
+
+bool stream_obj_file(const string &file_name, MeshSink &sink,
+    size_t batch_size) {
+  if (is_gzip_file(file_name)) {
+    return stream_gzip_obj_file(file_name, sink, batch_size);
+  }
+
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Plain reads rather than mmap so the resident set stays one buffer
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  ObjStreamParser parser(sink, batch_size);
+  vector<char> buffer(MESH_STREAM_READ_SIZE);
+
+  try {
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, buffer.data(), buffer.size())) != 0) {
+      if (bytes_read < 0) {
+        throw "Error reading .obj file";
+      }
+      parser.feed(buffer.data(), bytes_read);
+    }
+    parser.finish();
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  close(fd);
+  return true;
+}
+
+MeshStats :: MeshStats() {
+  float inf = numeric_limits<float>::infinity();
+
+  num_vertices = 0;
+  num_faces = 0;
+  min_index = numeric_limits<int>::max();
+  max_index = numeric_limits<int>::min();
+  min_corner.set_vertex(inf, inf, inf);
+  max_corner.set_vertex(-inf, -inf, -inf);
+}
+
+void MeshStatsSink :: add_vertices(const Vertex *vertices, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    stats.min_corner.x = min(stats.min_corner.x, vertices[i].x);
+    stats.min_corner.y = min(stats.min_corner.y, vertices[i].y);
+    stats.min_corner.z = min(stats.min_corner.z, vertices[i].z);
+    stats.max_corner.x = max(stats.max_corner.x, vertices[i].x);
+    stats.max_corner.y = max(stats.max_corner.y, vertices[i].y);
+    stats.max_corner.z = max(stats.max_corner.z, vertices[i].z);
+  }
+  stats.num_vertices += count;
+}
+
+void MeshStatsSink :: add_faces(const Face *faces, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    int low = min(faces[i].vertex1, min(faces[i].vertex2, faces[i].vertex3));
+    int high = max(faces[i].vertex1, max(faces[i].vertex2, faces[i].vertex3));
+    stats.min_index = min(stats.min_index, low);
+    stats.max_index = max(stats.max_index, high);
+  }
+  stats.num_faces += count;
+}
+
+bool compute_mesh_stats(const string &file_name, MeshStats &stats) {
+  MeshStatsSink sink;
+  if (!stream_obj_file(file_name, sink)) {
+    return false;
+  }
+  stats = sink.stats;
+  return true;
+}
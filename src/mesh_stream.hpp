@@ -0,0 +1,107 @@
+#ifndef MESH_STREAM_HPP
+#define MESH_STREAM_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "obj_parser.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+/* Streaming .obj reader.
+ *
+ * Instead of building a Model, records are handed to a MeshSink in batches
+ * of at most batch_size as the file is read through a fixed size buffer.
+ * Peak memory is the read buffer plus one batch of each kind, independent
+ * of the mesh size.
+ *
+ * Vertices are numbered in the order they are delivered, starting from 1.
+ * All vertices read before a face batch are delivered before that batch,
+ * so a face never refers to a vertex the sink has not seen yet.
+ */
+
+const size_t MESH_STREAM_BATCH_SIZE = 1 << 16;
+const size_t MESH_STREAM_READ_SIZE = 1 << 20;
+
+// Receives the records of a streamed mesh
+class MeshSink {
+  public:
+    virtual ~MeshSink() {}
+
+    virtual void add_vertices(const Vertex *vertices, size_t count) = 0;
+    virtual void add_faces(const Face *faces, size_t count) = 0;
+};
+
+// Sink that appends everything to a Model, whose filler vertex at index 0
+// lines up with the numbering from 1
+class ModelSink : public MeshSink {
+  public:
+    ModelSink(Model &model) : model(model) {}
+
+    void add_vertices(const Vertex *vertices, size_t count);
+    void add_faces(const Face *faces, size_t count);
+
+  private:
+    Model &model;
+};
+
+// Turns .obj text fed in arbitrary pieces into batches for a sink
+class ObjStreamParser {
+  public:
+    ObjStreamParser(MeshSink &sink, size_t batch_size = MESH_STREAM_BATCH_SIZE);
+
+    // Parse the complete lines in data, keeping any partial last line
+    void feed(const char *data, size_t size);
+    // Parse the last line (if it has no '\n') and flush both batches
+    void finish();
+
+  private:
+    MeshSink &sink;
+    size_t batch_size;
+
+    // Start of a line split across two feed calls
+    string partial_line;
+    // Vertex count for relative face indices
+    ObjParseState state;
+    vector<Vertex> vertex_batch;
+    vector<Face> face_batch;
+
+    void parse_line(const char *begin, const char *line_end);
+    void flush_vertices();
+    void flush_faces();
+};
+
+// Read file_name through a fixed size buffer into sink (inflating it first
+// if it is gzip compressed), false if it can not be opened
+bool stream_obj_file(const string &file_name, MeshSink &sink,
+    size_t batch_size = MESH_STREAM_BATCH_SIZE);
+
+// Summary of a mesh computed in one bounded memory pass
+struct MeshStats {
+  size_t num_vertices;
+  size_t num_faces;
+  // Smallest and largest vertex index used by any face
+  int min_index, max_index;
+  // Axis aligned bounding box of the vertices
+  Vertex min_corner, max_corner;
+
+  MeshStats();
+};
+
+// Sink that accumulates MeshStats
+class MeshStatsSink : public MeshSink {
+  public:
+    MeshStats stats;
+
+    void add_vertices(const Vertex *vertices, size_t count);
+    void add_faces(const Face *faces, size_t count);
+};
+
+// Bounding box and counts of file_name into stats without loading it,
+// false if the file can not be opened
+bool compute_mesh_stats(const string &file_name, MeshStats &stats);
+
+#endif
@@ -0,0 +1,85 @@
+#include "mesh_watcher.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "parser.hpp"
+#include "scene.hpp"
+
+using namespace std;
+
+// Events that mean a file has new, complete contents
+static const uint32_t MESH_CHANGE_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+MeshWatcher :: MeshWatcher(const Scene &scene) {
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    throw "Could not start watching mesh files";
+  }
+
+  for (size_t i = 0; i < scene.meshes.size(); ++i) {
+    string path = scene_mesh_path(scene.meshes[i]);
+
+    size_t slash = path.rfind('/');
+    string directory = (slash == string::npos) ? "." : path.substr(0, slash);
+    string name = (slash == string::npos) ? path : path.substr(slash + 1);
+
+    // Watching a directory twice gives back the same descriptor
+    int wd = inotify_add_watch(inotify_fd, directory.c_str(),
+        MESH_CHANGE_EVENTS);
+    if (wd < 0) {
+      close(inotify_fd);
+      throw "Could not watch the directory of a mesh file";
+    }
+    watched_files[make_pair(wd, name)].push_back(i);
+  }
+}
+
+MeshWatcher :: ~MeshWatcher() {
+  close(inotify_fd);
+}
+
+vector<int> MeshWatcher :: changed_meshes() {
+  vector<int> changed;
+
+  // Big enough for many events, aligned as the kernel expects
+  char buffer[16 * 1024]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+  while (true) {
+    ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      // EAGAIN: nothing more right now
+      break;
+    }
+
+    for (char *p = buffer; p < buffer + length; ) {
+      const struct inotify_event *event =
+        reinterpret_cast<const struct inotify_event *>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (event->len == 0 || !(event->mask & MESH_CHANGE_EVENTS)) {
+        continue;
+      }
+
+      map<pair<int, string>, vector<int> >::const_iterator watched =
+        watched_files.find(make_pair(event->wd, string(event->name)));
+      if (watched != watched_files.end()) {
+        changed.insert(changed.end(), watched->second.begin(),
+            watched->second.end());
+      }
+    }
+  }
+
+  // An editor may close the file several times for one save
+  sort(changed.begin(), changed.end());
+  changed.erase(unique(changed.begin(), changed.end()), changed.end());
+  return changed;
+}
@@ -0,0 +1,40 @@
+#ifndef MESH_WATCHER_HPP
+#define MESH_WATCHER_HPP
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "scene.hpp"
+
+using namespace std;
+
+/* Notices when the mesh files of a scene are rewritten (inotify).
+ *
+ * The directories holding the files are watched rather than the files, so
+ * editors that save by writing a new file and renaming it over the old one
+ * are seen too. Only finished writes count (close after writing, or a
+ * rename into place), never a half written file.
+ */
+class MeshWatcher {
+  public:
+    // Watch the files of scene.meshes as create_obj finds them. Throws if
+    // inotify is not available.
+    MeshWatcher(const Scene &scene);
+    ~MeshWatcher();
+
+    // Indices into scene.meshes of the files rewritten since the last call,
+    // each at most once. Never blocks.
+    vector<int> changed_meshes();
+
+  private:
+    int inotify_fd;
+    // (watch descriptor, file name in that directory) -> scene.meshes indices
+    map<pair<int, string>, vector<int> > watched_files;
+
+    MeshWatcher(const MeshWatcher &);
+    MeshWatcher &operator=(const MeshWatcher &);
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include "mesh_writer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "compact_mesh.hpp"
+#include "mesh_cache.hpp"
+#include "model.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "reorder.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+static_assert(sizeof(Vertex) == 3 * sizeof(float), "Vertex must be 3 floats");
+
+// Powers of ten that are exact doubles, the same ones scan_float uses
+static const double POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Magnitudes formatted by hand, everything else goes through snprintf.
+// Keeps the scale below 10^22 for up to 9 digits.
+static const double MIN_FAST_FLOAT = 1e-13;
+static const double MAX_FAST_FLOAT = 1e15;
+
+// Lines are formatted and written this many at a time
+static const size_t WRITE_CHUNK_LINES = 1 << 16;
+
+static bool is_little_endian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+}
+
+// "00" to "99", for writing two digits per division
+static const char DIGIT_PAIRS[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+// Write the decimal digits of value at out and return the end
+static char *format_digits(uint64_t value, char *out) {
+  char text[20];
+  char *p = text + sizeof(text);
+  while (value >= 100) {
+    p -= 2;
+    memcpy(p, DIGIT_PAIRS + 2 * (value % 100), 2);
+    value /= 100;
+  }
+  if (value >= 10) {
+    p -= 2;
+    memcpy(p, DIGIT_PAIRS + 2 * value, 2);
+  } else {
+    *--p = char('0' + value);
+  }
+
+  size_t length = text + sizeof(text) - p;
+  memcpy(out, p, length);
+  return out + length;
+}
+
+char *format_int(int value, char *out) {
+  uint64_t magnitude = value;
+  if (value < 0) {
+    *out++ = '-';
+    magnitude = -int64_t(value);
+  }
+  return format_digits(magnitude, out);
+}
+
+/* Round magnitude * 10^scale to digits and check that digits * 10^-scale
+ * comes back as magnitude through the same double then float rounding
+ * scan_float does.
+ */
+static bool round_trips(double magnitude, int scale, uint64_t &digits) {
+  double scaled = (scale >= 0) ? magnitude * POWERS_OF_TEN[scale]
+    : magnitude / POWERS_OF_TEN[-scale];
+  // Through int64_t, which converts in one instruction (digits < 10^10)
+  int64_t rounded = int64_t(scaled + 0.5);
+  digits = rounded;
+  double decoded = (scale >= 0) ? rounded / POWERS_OF_TEN[scale]
+    : rounded * POWERS_OF_TEN[-scale];
+  return float(decoded) == float(magnitude);
+}
+
+char *format_float(float value, char *out) {
+  double magnitude = fabs(double(value));
+  if (magnitude == 0) {
+    *out++ = '0';
+    return out;
+  }
+  if (!(magnitude >= MIN_FAST_FLOAT && magnitude < MAX_FAST_FLOAT)) {
+    // Huge, tiny, inf and nan; 9 digits always read back exactly
+    return out + snprintf(out, FORMAT_NUMBER_MAX, "%.9g", value);
+  }
+
+  // Decimal exponent of the leading digit
+  int exponent = 0;
+  if (magnitude >= 1) {
+    while (magnitude >= POWERS_OF_TEN[exponent + 1]) {
+      ++exponent;
+    }
+  } else {
+    while (magnitude * POWERS_OF_TEN[-exponent] < 1) {
+      --exponent;
+    }
+  }
+
+  // Fewest significant digits (1 to 9, 9 always work) that round trip.
+  // More digits are never further off, so a binary search finds it.
+  uint64_t digits = 0;
+  int scale = 0;
+  int low = 1, high = 9;
+  while (low < high) {
+    int precision = (low + high) / 2;
+    if (round_trips(magnitude, precision - 1 - exponent, digits)) {
+      high = precision;
+    } else {
+      low = precision + 1;
+    }
+  }
+  scale = low - 1 - exponent;
+  round_trips(magnitude, scale, digits);
+
+  while (scale > 0 && digits % 10 == 0) {
+    digits /= 10;
+    --scale;
+  }
+
+  if (value < 0) {
+    *out++ = '-';
+  }
+
+  if (scale <= 0) {
+    // Whole number, pad with zeros
+    out = format_digits(digits, out);
+    for (int i = 0; i < -scale; ++i) {
+      *out++ = '0';
+    }
+    return out;
+  }
+
+  char text[20];
+  int length = format_digits(digits, text) - text;
+  if (length <= scale) {
+    // 0.000ddd
+    *out++ = '0';
+    *out++ = '.';
+    for (int i = length; i < scale; ++i) {
+      *out++ = '0';
+    }
+    memcpy(out, text, length);
+    return out + length;
+  }
+
+  // ddd.ddd
+  memcpy(out, text, length - scale);
+  out += length - scale;
+  *out++ = '.';
+  memcpy(out, text + length - scale, scale);
+  return out + scale;
+}
+
+/* Write count items through format_range, which formats items
+ * [first, last) at out and returns the end of its text. Each item may
+ * take at most max_item_size bytes. Chunks are formatted a wave at a time
+ * (in parallel if asked) so memory stays bounded, and written in order.
+ */
+static bool write_items(FILE *out, size_t count, size_t max_item_size,
+    bool parallel,
+    const function<char *(size_t, size_t, char *)> &format_range) {
+  size_t num_chunks = (count + WRITE_CHUNK_LINES - 1) / WRITE_CHUNK_LINES;
+  size_t wave_size = parallel ? 2 * num_worker_threads() : 1;
+  vector<vector<char> > buffers(wave_size);
+
+  for (size_t wave = 0; wave < num_chunks; wave += wave_size) {
+    size_t wave_chunks = min(wave_size, num_chunks - wave);
+
+    auto format_chunk = [&](size_t j) {
+      size_t first = (wave + j) * WRITE_CHUNK_LINES;
+      size_t last = min(count, first + WRITE_CHUNK_LINES);
+      vector<char> &buffer = buffers[j];
+      buffer.resize((last - first) * max_item_size);
+      char *end = format_range(first, last, buffer.data());
+      buffer.resize(end - buffer.data());
+    };
+
+    if (parallel) {
+      parallel_for(wave_chunks, format_chunk);
+    } else {
+      for (size_t j = 0; j < wave_chunks; ++j) {
+        format_chunk(j);
+      }
+    }
+
+    for (size_t j = 0; j < wave_chunks; ++j) {
+      if (fwrite(buffers[j].data(), 1, buffers[j].size(), out)
+          != buffers[j].size()) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Write file_name through write_body on a temporary that is renamed into
+ * place, so readers never see a partial file.
+ */
+static bool write_file_atomically(const string &file_name,
+    const function<bool(FILE *)> &write_body) {
+  string temp_file = file_name + ".tmp" + to_string(getpid());
+
+  FILE *out = fopen(temp_file.c_str(), "wb");
+  if (out == NULL) {
+    return false;
+  }
+
+  bool ok = write_body(out);
+  ok = (fclose(out) == 0) && ok;
+  if (!ok || rename(temp_file.c_str(), file_name.c_str()) != 0) {
+    remove(temp_file.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+static size_t num_model_vertices(const Model &model) {
+  // Index 0 is a filler so faces can use 1-based indices
+  return model.vertices.empty() ? 0 : model.vertices.size() - 1;
+}
+
+bool write_obj_file(const string &file_name, const Model &model,
+    const MeshWriteOptions &options) {
+  const Vertex *vertices = model.vertices.data() + 1;
+  const Face *faces = model.faces.data();
+  size_t num_vertices = num_model_vertices(model);
+
+  return write_file_atomically(file_name, [&](FILE *out) {
+    bool ok = write_items(out, num_vertices, 3 * FORMAT_NUMBER_MAX + 8,
+        options.parallel, [&](size_t first, size_t last, char *p) {
+      for (size_t i = first; i < last; ++i) {
+        *p++ = 'v';
+        *p++ = ' ';
+        p = format_float(vertices[i].x, p);
+        *p++ = ' ';
+        p = format_float(vertices[i].y, p);
+        *p++ = ' ';
+        p = format_float(vertices[i].z, p);
+        *p++ = '\n';
+      }
+      return p;
+    });
+
+    return ok && write_items(out, model.faces.size(),
+        3 * FORMAT_NUMBER_MAX + 8, options.parallel,
+        [&](size_t first, size_t last, char *p) {
+      for (size_t i = first; i < last; ++i) {
+        *p++ = 'f';
+        *p++ = ' ';
+        p = format_int(faces[i].vertex1, p);
+        *p++ = ' ';
+        p = format_int(faces[i].vertex2, p);
+        *p++ = ' ';
+        p = format_int(faces[i].vertex3, p);
+        *p++ = '\n';
+      }
+      return p;
+    });
+  });
+}
+
+bool write_ply_file(const string &file_name, const Model &model,
+    const MeshWriteOptions &options) {
+  const Face *faces = model.faces.data();
+  size_t num_vertices = num_model_vertices(model);
+
+  string header = string("ply\n")
+    + "format " + (is_little_endian() ? "binary_little_endian"
+        : "binary_big_endian") + " 1.0\n"
+    + "element vertex " + to_string(num_vertices) + "\n"
+    + "property float x\n"
+    + "property float y\n"
+    + "property float z\n"
+    + "element face " + to_string(model.faces.size()) + "\n"
+    + "property list uchar int vertex_indices\n"
+    + "end_header\n";
+
+  // A vertex count byte and three 0-based indices per face
+  const size_t face_size = 1 + 3 * sizeof(int32_t);
+
+  return write_file_atomically(file_name, [&](FILE *out) {
+    if (fwrite(header.data(), 1, header.size(), out) != header.size()
+        || fwrite(model.vertices.data() + 1, sizeof(Vertex), num_vertices,
+          out) != num_vertices) {
+      return false;
+    }
+
+    return write_items(out, model.faces.size(), face_size, options.parallel,
+        [&](size_t first, size_t last, char *p) {
+      for (size_t i = first; i < last; ++i) {
+        int32_t indices[3] = {
+          faces[i].vertex1 - 1, faces[i].vertex2 - 1, faces[i].vertex3 - 1
+        };
+        *p++ = 3;
+        memcpy(p, indices, sizeof(indices));
+        p += sizeof(indices);
+      }
+      return p;
+    });
+  });
+}
+
+bool write_mesh_file(const string &file_name, const Model &model,
+    const MeshWriteOptions &options) {
+  // Meshes reordered at load go back out in the order they were read in
+  if (model.original_order && options.file_order) {
+    Model restored;
+    restore_file_order(model, restored);
+    MeshWriteOptions restored_options = options;
+    restored_options.file_order = false;
+    return write_mesh_file(file_name, restored, restored_options);
+  }
+
+  if (has_extension(file_name, ".cmesh")) {
+    return write_compact_mesh(file_name, model, options.position_bits);
+  }
+
+  bool ok = has_extension(file_name, ".ply")
+    ? write_ply_file(file_name, model, options)
+    : write_obj_file(file_name, model, options);
+
+  // Both formats read back exactly, so the cache matches what parsing the
+  // new file would give
+  if (ok && options.write_cache) {
+    save_mesh_cache(file_name, model);
+  }
+  return ok;
+}
@@ -0,0 +1,59 @@
+#ifndef MESH_WRITER_HPP
+#define MESH_WRITER_HPP
+
+#include <string>
+
+#include "compact_mesh.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+/* Writing Model::vertices and Model::faces back out.
+ *
+ * Numbers are formatted by hand into large buffers (no iostreams or
+ * printf per value), a chunk of lines at a time, and each chunk is written
+ * with one fwrite. Floats get the shortest decimal that scan_float reads
+ * back to the same value, so a written .obj parses to exactly the Model it
+ * came from. Files are written to a temporary and renamed into place.
+ */
+
+struct MeshWriteOptions {
+  // Format chunks on all worker threads (see parallel)
+  bool parallel;
+  // Also save <file>.cache so reading the file back skips parsing (off by
+  // default, exports should not leave caches behind)
+  bool write_cache;
+  // Bits per axis for .cmesh files
+  int position_bits;
+  // Undo reordering at load (see reorder) in write_mesh_file
+  bool file_order;
+
+  MeshWriteOptions()
+    : parallel(true), write_cache(false),
+      position_bits(COMPACT_MESH_DEFAULT_BITS), file_order(true) {}
+};
+
+// Longest text format_float or format_int can produce
+const int FORMAT_NUMBER_MAX = 32;
+
+// Write value at out and return the end of the text. Floats use the
+// fewest significant digits that read back exactly; there is no
+// terminating '\0'.
+char *format_float(float value, char *out);
+char *format_int(int value, char *out);
+
+// Write model as "v x y z" and "f a b c" lines
+bool write_obj_file(const string &file_name, const Model &model,
+    const MeshWriteOptions &options = MeshWriteOptions());
+
+// Write model as a binary .ply in the host byte order
+bool write_ply_file(const string &file_name, const Model &model,
+    const MeshWriteOptions &options = MeshWriteOptions());
+
+// Write model as .ply, .cmesh or (otherwise) .obj by the extension of
+// file_name, in file order unless options say otherwise, false if it can
+// not be written
+bool write_mesh_file(const string &file_name, const Model &model,
+    const MeshWriteOptions &options = MeshWriteOptions());
+
+#endif
@@ -1,12 +1,15 @@
 #include "model.hpp"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory> // shared_ptr
 #include <string>
 #include <vector>
 
 #include "halfedge.hpp"
+#include "index_buffer.hpp"
 #include "structs.hpp"
 
 using namespace std;
@@ -22,7 +25,7 @@ Model :: Model() {
 }
 
 // constructor using file
-Model :: Model(string raw_file_name) {
+Model :: Model(const string &raw_file_name) {
   name = get_name(raw_file_name);
   setup_vertices();
   faces = vector<Face>();
@@ -30,9 +33,18 @@ Model :: Model(string raw_file_name) {
 }
 
 // helper function for constructor to get object name
-string Model :: get_name(string raw_file_name) {
-  // Remove .obj from name
-  return raw_file_name.substr(0, raw_file_name.size() - 4);
+string Model :: get_name(const string &raw_file_name) const {
+  // Remove the extension (.obj, .ply, .cmesh, also .obj.gz) from name
+  size_t end = raw_file_name.size();
+  if (end >= 3 && raw_file_name.compare(end - 3, 3, ".gz") == 0) {
+    end -= 3;
+  }
+  size_t dot = raw_file_name.rfind('.', end - 1);
+  size_t slash = raw_file_name.rfind('/');
+  if (dot == string::npos || (slash != string::npos && dot < slash)) {
+    return raw_file_name;
+  }
+  return raw_file_name.substr(0, dot);
 }
 
 // helper function for constructor to get vertices
@@ -42,27 +54,41 @@ void Model :: setup_vertices() {
   vertices.push_back(Vertex(0, 0, 0));
 }
 
-void Model :: set_variables() {
-  Mesh_Data *mesh_data = new Mesh_Data;
-  mesh_data->vertices = &vertices;
-  mesh_data->faces = &faces;
+// Fill corners from the oriented halfedges and compute the normals, for
+// either index width
+template<typename Index>
+static void build_render_buffers(Model &model, Index *corners) {
+  const HalfedgeMesh &halfedges = *model.halfedges;
+  size_t num_faces = model.faces.size();
+
+  // Orienting may have flipped faces, read the corners back in face order
+  // (build_HE checked them against the vertices, which also keeps too
+  // large indices from wrapping around at 16 bits)
+  for (size_t h = 0; h < 3 * num_faces; ++h) {
+    corners[h] = halfedges.edges[h].vertex;
+  }
 
-  vector<HEV *> *hevs = new vector<HEV *>();
-  vector<HEF *> *hefs = new vector<HEF *>();
-  build_HE(mesh_data, hevs, hefs);
+  calc_vertex_normals(model.vertices, corners, 3 * num_faces,
+      model.normal_buffer);
+}
 
+void Model :: build_halfedges() {
+  shared_ptr<HalfedgeMesh> built(new HalfedgeMesh());
+  build_HE(faces, vertices.size(), *built);
+  halfedges = built;
+}
 
-  HE* half_edge;
-  for (vector<HEF*>::iterator face_it = hefs->begin(); face_it != hefs->end(); face_it++) {
-    half_edge = (*face_it)->edge;
-    vertex_buffer.push_back(vertices[half_edge->vertex->index]);
-    normal_buffer.push_back(calc_vertex_normal(half_edge->vertex));
+void Model :: set_variables() {
+  // Copies come with the halfedges of their mesh
+  if (!halfedges_current()) {
+    build_halfedges();
+  }
 
-    for (int i = 0; i < 2; i++) {
-      half_edge = half_edge->next;
-      vertex_buffer.push_back(vertices[half_edge->vertex->index]);
-      normal_buffer.push_back(calc_vertex_normal(half_edge->vertex));
-    }
+  index_buffer.reset(vertices.size(), 3 * faces.size());
+  if (index_buffer.is_short()) {
+    build_render_buffers(*this, index_buffer.get<uint16_t>());
+  } else {
+    build_render_buffers(*this, index_buffer.get<uint32_t>());
   }
 
   ambient_reflect[0] = material->ambient->red;
@@ -78,7 +104,74 @@ void Model :: set_variables() {
   specular_reflect[2] = material->specular->blue;
 
   shininess = material->shininess;
+}
+
+void Model :: update_positions() {
+  if (!halfedges_current()) {
+    set_variables();
+    return;
+  }
+
+  if (index_buffer.is_short()) {
+    calc_vertex_normals(vertices, index_buffer.get<uint16_t>(),
+        index_buffer.size(), normal_buffer);
+  } else {
+    calc_vertex_normals(vertices, index_buffer.get<uint32_t>(),
+        index_buffer.size(), normal_buffer);
+  }
+}
+
+bool Model :: halfedges_current() const {
+  if (!halfedges || halfedges->num_faces() != faces.size()
+      || halfedges->num_vertices() != vertices.size()) {
+    return false;
+  }
+
+  // Orienting keeps the first corner of every face and at most swaps the
+  // other two, so each face must still be there, as it was or reversed
+  const vector<HE> &edges = halfedges->edges;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    const Face &face = faces[f];
+    uint32_t v2 = edges[3 * f + 1].vertex;
+    uint32_t v3 = edges[3 * f + 2].vertex;
+    if (edges[3 * f].vertex != uint32_t(face.vertex1)
+        || !((v2 == uint32_t(face.vertex2) && v3 == uint32_t(face.vertex3))
+          || (v2 == uint32_t(face.vertex3) && v3 == uint32_t(face.vertex2)))) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  delete mesh_data;
-  delete_HE(hevs, hefs);
+void Model :: get_bounds(Vertex &min_corner, Vertex &max_corner) const {
+  if (vertices.size() < 2) {
+    min_corner = Vertex();
+    max_corner = Vertex();
+    return;
+  }
+
+  min_corner = vertices[1];
+  max_corner = vertices[1];
+  for (size_t i = 2; i < vertices.size(); ++i) {
+    min_corner.x = min(min_corner.x, vertices[i].x);
+    min_corner.y = min(min_corner.y, vertices[i].y);
+    min_corner.z = min(min_corner.z, vertices[i].z);
+    max_corner.x = max(max_corner.x, vertices[i].x);
+    max_corner.y = max(max_corner.y, vertices[i].y);
+    max_corner.z = max(max_corner.z, vertices[i].z);
+  }
+}
+
+size_t Model :: memory_bytes() const {
+  size_t bytes = vertices.capacity() * sizeof(Vertex)
+    + faces.capacity() * sizeof(Face)
+    + normal_buffer.capacity() * sizeof(Normal)
+    + index_buffer.bytes();
+
+  // Split evenly between everything holding them, so the copies of a mesh
+  // add up to the halfedges once (about as much as the rest put together)
+  if (halfedges) {
+    bytes += halfedges->memory_bytes() / halfedges.use_count();
+  }
+  return bytes;
 }
@@ -2,12 +2,14 @@
 #define MODEL_HPP
 
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory> // shared_ptr
 #include <string>
 #include <vector>
 
 #include "halfedge.hpp"
+#include "index_buffer.hpp"
 #include "structs.hpp"
 
 using namespace std;
@@ -62,6 +64,13 @@ struct Material {
   }
 };
 
+// Where the vertices and faces of a reordered mesh were in its file
+struct MeshOrder {
+  // file index of every vertex (0 for the filler) and of every face
+  vector<uint32_t> vertices;
+  vector<uint32_t> faces;
+};
+
 /* The following struct is used to represent objects.
  *
  */
@@ -72,9 +81,19 @@ class Model {
     vector<Face> faces;
     MaterialPtr material;
 
-    // Vertices and normals in order by face
-    vector<Vertex> vertex_buffer;
+    // Normals by vertex index (like vertices) and the consistently oriented
+    // corners of the faces into both, drawn with glDrawElements
     vector<Normal> normal_buffer;
+    IndexBuffer index_buffer;
+
+    // Oriented topology of the faces, built by set_variables (or once for
+    // a shared mesh, see mesh_library) and shared by every copy with the
+    // same faces
+    shared_ptr<const HalfedgeMesh> halfedges;
+
+    // Set if vertices and faces were renumbered at load (see reorder), the
+    // copies of a mesh share it
+    shared_ptr<const MeshOrder> original_order;
 
     vector<Transforms> transform_sets;
 
@@ -88,15 +107,30 @@ class Model {
     // constructor without arguments
     Model();
     // constructor using file
-    Model(string raw_file_name);
+    Model(const string &raw_file_name);
 
     // helper function for constructor to get object name
-    string get_name(string raw_file_name);
+    string get_name(const string &raw_file_name) const;
     // helper function for constructor to setup vertices
     void setup_vertices();
 
+    // Build halfedges from the current faces (throws like build_HE)
+    void build_halfedges();
     // Set redundant varibles to be used in OpenGL framework
     void set_variables();
+    // After vertices have moved but the faces have not (e.g. smoothing):
+    // recompute the normals and keep the halfedges and index buffer
+    void update_positions();
+    // Whether halfedges were built from the current faces (checks every
+    // face, not just the counts)
+    bool halfedges_current() const;
+
+    // Axis aligned box around vertices (the filler at index 0 is skipped)
+    void get_bounds(Vertex &min_corner, Vertex &max_corner) const;
+
+    // Bytes held by the mesh and its render buffers, plus this copy's share
+    // of the halfedges it shares with the other copies of the mesh
+    size_t memory_bytes() const;
 };
 
 #endif
@@ -1,11 +1,11 @@
 #include "model_transform.hpp"
 
 #include <memory> // shared_ptr
-#include <sstream>
 #include <string>
 #include <vector>
 
 #include "camera.hpp"
+#include "mesh_library.hpp"
 #include "model.hpp"
 #include "structs.hpp"
 
@@ -18,14 +18,18 @@ using ModelPtr = shared_ptr<Model>;
 using MatrixPtr = shared_ptr<Eigen::MatrixXd>;
 
 // Perform geometric transforms on vertices
-vector<Vertex> ModelTransform :: transform_model_vertices(MatrixPtr trans_mat) {
+vector<Vertex> ModelTransform :: transform_model_vertices(
+    const MatrixPtr &trans_mat) const {
+  // One allocation for the whole array, none per vertex
   vector<Vertex> vertices = vector<Vertex>();
+  vertices.reserve(model->vertices.size());
   // Index 0 is filler because vertices are 1-indexed
   vertices.push_back(Vertex());
 
-  vector<Vertex>::iterator vertex_it = ++(model.vertices.begin());
-  while (vertex_it != model.vertices.end()) {
-    vertices.push_back(transform_vertex(trans_mat, *vertex_it));
+  Eigen::Matrix4d fixed_trans_mat = *trans_mat;
+  vector<Vertex>::const_iterator vertex_it = ++(model->vertices.begin());
+  while (vertex_it != model->vertices.end()) {
+    vertices.push_back(transform_vertex(fixed_trans_mat, *vertex_it));
     ++vertex_it;
   }
 
@@ -33,14 +37,17 @@ vector<Vertex> ModelTransform :: transform_model_vertices(MatrixPtr trans_mat) {
 }
 
 // Apply all transformations to the vertices to cartesian NDC
-Model ModelTransform :: apply_trans_mat(MatrixPtr trans_mat, MatrixPtr norm_trans_mat) {
+Model ModelTransform :: apply_trans_mat(const MatrixPtr &trans_mat,
+    const MatrixPtr &norm_trans_mat, int copy_num) const {
   Model copy = Model();
   copy.vertices = transform_model_vertices(trans_mat);
-  copy.faces = model.faces;
-
-  std::stringstream copy_name;
-  copy_name << name << "_copy" << (++copy_num);
-  copy.name = copy_name.str();
+  // Every copy owns its faces (smoothing and export use them), so this is
+  // the one allocation of the copy's face array
+  copy.faces = model->faces;
+  copy.original_order = model->original_order;
+  // Same faces, so the same halfedges
+  copy.halfedges = model->halfedges;
+  copy.name = name + "_copy" + to_string(copy_num);
 
   return copy;
 }
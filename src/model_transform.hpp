@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "camera.hpp"
+#include "mesh_library.hpp"
 #include "model.hpp"
 #include "structs.hpp"
 
@@ -19,19 +20,23 @@ using MatrixPtr = shared_ptr<Eigen::MatrixXd>;
 
 class ModelTransform {
   public:
-    Model model;
+    // Shared with every other object made from the same file
+    MeshPtr model;
+    // Number of copies made so far
     int copy_num;
     string name;
 
     CameraPtr cam;
 
     // Perform geometric transforms on vertices
-    vector<Vertex> transform_model_vertices(MatrixPtr trans_mat);
+    vector<Vertex> transform_model_vertices(const MatrixPtr &trans_mat) const;
     // Perform geometric transforms on normals
     vector<Normal> transform_model_normals(MatrixPtr trans_mat);
 
-    // Apply all transformations to the vertices to cartesian NDC
-    Model apply_trans_mat(MatrixPtr trans_mat, MatrixPtr norm_trans_mat);
+    // Apply all transformations to the vertices to cartesian NDC, the copy
+    // is named after copy_num
+    Model apply_trans_mat(const MatrixPtr &trans_mat,
+        const MatrixPtr &norm_trans_mat, int copy_num) const;
 };
 
 #endif
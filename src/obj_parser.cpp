@@ -0,0 +1,431 @@
+#include "obj_parser.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "model.hpp"
+#include "parallel.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+// Powers of ten that are exactly representable as doubles
+static const double exact_powers_of_10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(char c) {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char *find_line_end(const char *p, const char *end) {
+#ifdef __SSE2__
+  // Compare 16 bytes at a time against '\n'
+  const __m128i newline = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && *p != '\n') {
+    ++p;
+  }
+  return p;
+}
+
+const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && is_blank(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+bool scan_int(const char *&p, const char *end, int &value) {
+  const char *s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+')) {
+    negative = *s == '-';
+    ++s;
+  }
+
+  if (s == end || !is_digit(*s)) {
+    return false;
+  }
+
+  int64_t result = 0;
+  while (s < end && is_digit(*s)) {
+    result = result * 10 + (*s - '0');
+    if (result > numeric_limits<int>::max()) {
+      return false;
+    }
+    ++s;
+  }
+
+  value = static_cast<int>(negative ? -result : result);
+  p = s;
+  return true;
+}
+
+// Slow path for numbers the fast path can not round correctly
+static bool scan_float_fallback(const char *&p, const char *end, float &value) {
+  char token[128];
+  size_t length = 0;
+  while (p + length < end && length < sizeof(token) - 1
+      && !is_blank(p[length]) && p[length] != '\n') {
+    token[length] = p[length];
+    ++length;
+  }
+  token[length] = '\0';
+
+  // strtof rather than strtod, rounding to double first could land on a
+  // halfway point between two floats
+  char *token_end;
+  float result = strtof(token, &token_end);
+  if (token_end == token) {
+    return false;
+  }
+
+  value = result;
+  p += token_end - token;
+  return true;
+}
+
+bool scan_float(const char *&p, const char *end, float &value) {
+  const char *s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+')) {
+    negative = *s == '-';
+    ++s;
+  }
+
+  // Collect up to 19 significant digits, the rest only move the exponent
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  bool any_digits = false;
+
+  while (s < end && is_digit(*s)) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*s - '0');
+      digits += mantissa != 0;
+    } else {
+      ++exponent;
+    }
+    any_digits = true;
+    ++s;
+  }
+
+  if (s < end && *s == '.') {
+    ++s;
+    while (s < end && is_digit(*s)) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*s - '0');
+        digits += mantissa != 0;
+        --exponent;
+      }
+      any_digits = true;
+      ++s;
+    }
+  }
+
+  if (!any_digits) {
+    // nan, inf and friends
+    return scan_float_fallback(p, end, value);
+  }
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    const char *e = s + 1;
+    bool exp_negative = false;
+    if (e < end && (*e == '-' || *e == '+')) {
+      exp_negative = *e == '-';
+      ++e;
+    }
+    // An 'e' without digits is not part of the number
+    if (e < end && is_digit(*e)) {
+      int exp_value = 0;
+      while (e < end && is_digit(*e)) {
+        if (exp_value < 100000) {
+          exp_value = exp_value * 10 + (*e - '0');
+        }
+        ++e;
+      }
+      exponent += exp_negative ? -exp_value : exp_value;
+      s = e;
+    }
+  }
+
+  // A mantissa below 2^53 scaled by an exact power of ten is rounded once,
+  // which is what strtod would give us
+  if (mantissa >= (uint64_t(1) << 53) || exponent < -22 || exponent > 22) {
+    return scan_float_fallback(p, end, value);
+  }
+
+  double result = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    result /= exact_powers_of_10[-exponent];
+  } else {
+    result *= exact_powers_of_10[exponent];
+  }
+
+  // The result is a normal float here. If the double sits exactly halfway
+  // between two floats (the 29 bits below float precision are 1000...0),
+  // rounding it again may go the wrong way.
+  uint64_t bits;
+  memcpy(&bits, &result, sizeof(bits));
+  if ((bits & 0x1FFFFFFF) == 0x10000000) {
+    return scan_float_fallback(p, end, value);
+  }
+
+  value = static_cast<float>(negative ? -result : result);
+  p = s;
+  return true;
+}
+
+// Parse "v x y z [w]", p is just past the 'v'
+static void parse_vertex(const char *p, const char *line_end,
+    vector<Vertex> &vertices, ObjParseState &state) {
+  float coords[3];
+  for (int i = 0; i < 3; ++i) {
+    p = skip_blanks(p, line_end);
+    if (!scan_float(p, line_end, coords[i])) {
+      throw "Wrong number of arguments to vertex line";
+    }
+  }
+
+  vertices.push_back(Vertex(coords[0], coords[1], coords[2]));
+  ++state.num_vertices;
+}
+
+// Read one face corner "v", "v/vt", "v//vn" or "v/vt/vn" and return the
+// vertex index, resolving negative indices against the vertices seen so far
+static int scan_corner(const char *&p, const char *line_end,
+    ObjParseState &state, bool &relative) {
+  int index;
+  if (!scan_int(p, line_end, index)) {
+    throw "Wrong number of arguments to face line";
+  }
+
+  // Texture and normal indices are not used, just step over them
+  for (int slot = 0; slot < 2 && p < line_end && *p == '/'; ++slot) {
+    ++p;
+    int unused;
+    scan_int(p, line_end, unused);
+  }
+
+  if (p < line_end && !is_blank(*p)) {
+    throw "Bad vertex in face line";
+  }
+
+  relative = index < 0;
+  if (index == 0) {
+    throw "Vertex index 0 in face line";
+  } else if (relative) {
+    index += state.num_vertices + 1;
+    if (index <= 0 && state.relative_corners == NULL) {
+      throw "Relative vertex index before the first vertex in face line";
+    }
+  }
+  return index;
+}
+
+// Parse "f c1 c2 c3 ...", p is just past the 'f'. Polygons are split into
+// a fan around the first corner, so only the first and previous corners
+// have to be remembered.
+static void parse_face(const char *p, const char *line_end,
+    vector<Face> &faces, ObjParseState &state) {
+  int corners[3];
+  bool relative[3];
+  int num_corners = 0;
+
+  while (true) {
+    p = skip_blanks(p, line_end);
+    if (p == line_end) {
+      break;
+    }
+
+    int slot = (num_corners < 2) ? num_corners : 2;
+    corners[slot] = scan_corner(p, line_end, state, relative[slot]);
+    ++num_corners;
+
+    if (num_corners >= 3) {
+      faces.push_back(Face(corners[0], corners[1], corners[2]));
+
+      if (state.relative_corners != NULL) {
+        uint64_t position = faces.size() - 1;
+        for (int i = 0; i < 3; ++i) {
+          if (relative[i]) {
+            state.relative_corners->push_back(position << 2 | i);
+          }
+        }
+      }
+
+      corners[1] = corners[2];
+      relative[1] = relative[2];
+    }
+  }
+
+  if (num_corners < 3) {
+    throw "Wrong number of arguments to face line";
+  }
+}
+
+// True when the statement at s is exactly keyword
+static inline bool is_statement(const char *s, const char *line_end,
+    char keyword) {
+  return s[0] == keyword && (s + 1 == line_end || is_blank(s[1]));
+}
+
+void parse_obj_line(const char *begin, const char *line_end,
+    vector<Vertex> &vertices, vector<Face> &faces, ObjParseState &state) {
+  const char *s = skip_blanks(begin, line_end);
+
+  if (s == line_end) {
+    // blank line
+  } else if (is_statement(s, line_end, 'v')) {
+    parse_vertex(s + 1, line_end, vertices, state);
+  } else if (is_statement(s, line_end, 'f')) {
+    parse_face(s + 1, line_end, faces, state);
+  }
+  // Everything else (comments, vt, vn, o, g, s, usemtl, mtllib, l, ...)
+  // carries nothing the Model stores and is skipped without being read
+}
+
+// Parse [begin, end) with state, which starts at the beginning of a file
+// unless the caller rebases the relative corners afterwards
+static void parse_obj_range(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces, ObjParseState &state) {
+  const char *p = begin;
+  while (p < end) {
+    const char *line_end = find_line_end(p, end);
+    parse_obj_line(p, line_end, vertices, faces, state);
+    p = line_end + 1;
+  }
+}
+
+void parse_obj_lines(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces) {
+  ObjParseState state;
+  parse_obj_range(begin, end, vertices, faces, state);
+}
+
+// Vertices and faces parsed from one chunk of the file
+struct ObjChunk {
+  const char *begin, *end;
+  vector<Vertex> vertices;
+  vector<Face> faces;
+  // Corners given as relative indices, counted from the chunk start
+  vector<uint64_t> relative_corners;
+};
+
+void parse_obj_lines_parallel(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces, size_t num_chunks) {
+  size_t size = end - begin;
+  if (num_chunks < 1) {
+    num_chunks = 1;
+  }
+
+  // Cut at roughly equal byte offsets, then move each cut past the next
+  // newline so no line is split between two chunks
+  vector<ObjChunk> chunks(num_chunks);
+  const char *chunk_begin = begin;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    const char *chunk_end = end;
+    if (i + 1 < num_chunks) {
+      chunk_end = begin + size / num_chunks * (i + 1);
+      if (chunk_end < chunk_begin) {
+        chunk_end = chunk_begin;
+      }
+      chunk_end = find_line_end(chunk_end, end);
+      if (chunk_end < end) {
+        ++chunk_end;
+      }
+    }
+
+    chunks[i].begin = chunk_begin;
+    chunks[i].end = chunk_end;
+    chunk_begin = chunk_end;
+  }
+
+  parallel_for(num_chunks, [&](size_t i) {
+    ObjParseState state;
+    state.relative_corners = &chunks[i].relative_corners;
+    parse_obj_range(chunks[i].begin, chunks[i].end,
+        chunks[i].vertices, chunks[i].faces, state);
+  });
+
+  // Rebase relative indices by the vertices in earlier chunks. Absolute
+  // indices are already right, so chunks are then concatenated in file
+  // order to keep the 1-based numbering build_HE expects.
+  int vertices_before = 0;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    vector<uint64_t> &relative_corners = chunks[i].relative_corners;
+    for (size_t j = 0; j < relative_corners.size(); ++j) {
+      Face &face = chunks[i].faces[relative_corners[j] >> 2];
+      int corner = relative_corners[j] & 3;
+      int &index = (corner == 0) ? face.vertex1
+        : (corner == 1) ? face.vertex2 : face.vertex3;
+      index += vertices_before;
+      if (index <= 0) {
+        throw "Relative vertex index before the first vertex in face line";
+      }
+    }
+    vertices_before += chunks[i].vertices.size();
+  }
+
+  vector<size_t> vertex_offsets(num_chunks), face_offsets(num_chunks);
+  size_t num_vertices = vertices.size();
+  size_t num_faces = faces.size();
+  for (size_t i = 0; i < num_chunks; ++i) {
+    vertex_offsets[i] = num_vertices;
+    face_offsets[i] = num_faces;
+    num_vertices += chunks[i].vertices.size();
+    num_faces += chunks[i].faces.size();
+  }
+
+  vertices.resize(num_vertices);
+  faces.resize(num_faces, Face(0, 0, 0));
+
+  parallel_for(num_chunks, [&](size_t i) {
+    copy(chunks[i].vertices.begin(), chunks[i].vertices.end(),
+        vertices.begin() + vertex_offsets[i]);
+    copy(chunks[i].faces.begin(), chunks[i].faces.end(),
+        faces.begin() + face_offsets[i]);
+    vector<Vertex>().swap(chunks[i].vertices);
+    vector<Face>().swap(chunks[i].faces);
+  });
+}
+
+bool parse_obj_file(const string &file_name, Model &model) {
+  MappedFile file;
+  if (!file.open(file_name)) {
+    return false;
+  }
+
+  size_t num_threads = num_worker_threads();
+  if (file.size() >= PARALLEL_PARSE_MIN_BYTES && num_threads > 1) {
+    parse_obj_lines_parallel(file.data(), file.end(),
+        model.vertices, model.faces, num_threads);
+  } else {
+    parse_obj_lines(file.data(), file.end(), model.vertices, model.faces);
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef OBJ_PARSER_HPP
+#define OBJ_PARSER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+/* Allocation free .obj parsing.
+ *
+ * The file is mapped with mmap and parsed in place: lines are found with a
+ * vectorized newline scan and numbers are read with hand written scanners
+ * instead of building an istringstream per line. Vertices and faces are
+ * appended straight into the destination vectors.
+ */
+
+// Return a pointer to the next '\n' at or after p, or end if there is none
+const char *find_line_end(const char *p, const char *end);
+
+// Skip spaces, tabs and carriage returns but not newlines
+const char *skip_blanks(const char *p, const char *end);
+
+// Read a number starting at p and advance p past it, false if p is not
+// at a number. Neither function allocates or looks at the locale.
+bool scan_int(const char *&p, const char *end, int &value);
+bool scan_float(const char *&p, const char *end, float &value);
+
+// Running state of a parse that parse_obj_line reads and updates
+struct ObjParseState {
+  // Vertices seen so far, negative (relative) face indices count back
+  // from here
+  int num_vertices;
+  // When set, relative indices that reach before the first vertex are
+  // allowed and every relative face corner is recorded here as
+  // (face position << 2 | corner) so the caller can rebase it
+  vector<uint64_t> *relative_corners;
+
+  ObjParseState() : num_vertices(0), relative_corners(NULL) {}
+};
+
+// Parse one line [begin, line_end) without its '\n'. Vertices and faces
+// are appended; faces may use "v", "v/vt", "v//vn" or "v/vt/vn" corners
+// and negative indices, and polygons are split into triangle fans.
+// Comments, vt, vn, o, g, s, usemtl and other statements are skipped.
+void parse_obj_line(const char *begin, const char *line_end,
+    vector<Vertex> &vertices, vector<Face> &faces, ObjParseState &state);
+
+// Parse a whole .obj text buffer, appending to vertices and faces
+void parse_obj_lines(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces);
+
+// Same as parse_obj_lines but splits the buffer at newlines into
+// num_chunks pieces that are parsed concurrently and merged in file order
+void parse_obj_lines_parallel(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces, size_t num_chunks);
+
+// Files at least this big are parsed with parse_obj_lines_parallel
+const size_t PARALLEL_PARSE_MIN_BYTES = 8 << 20;
+
+// Map file_name and parse it into model, false if it can not be mapped
+bool parse_obj_file(const string &file_name, Model &model);
+
+#endif
@@ -4,14 +4,27 @@
 #include <GL/glut.h>
 #include <math.h>
 #define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <string>
 #include <vector>
 
+#include "alloc_counter.hpp"
 #include "arcball.hpp"
 #include "camera.hpp"
 #include "implicit_fairing.hpp"
+#include "index_buffer.hpp"
+#include "lazy_loading.hpp"
+#include "load_options.hpp"
+#include "mesh_library.hpp"
+#include "mesh_watcher.hpp"
+#include "mesh_writer.hpp"
 #include "model.hpp"
 #include "parser.hpp"
+#include "scene.hpp"
+#include "scene_loader.hpp"
 #include "structs.hpp"
 #include "transform_obj.hpp"
 
@@ -80,6 +93,10 @@ void display(void) {
   glMultMatrixd(cam_rotation);
   delete[] cam_rotation;
 
+  if (lazy_mode) {
+    update_object_visibility();
+  }
+
   set_lights();
   draw_objects();
 
@@ -119,10 +136,47 @@ void set_lights() {
   }
 }
 
+// GL type of the corners in an IndexBuffer
+template<typename Index>
+static GLenum gl_index_type();
+
+template<>
+GLenum gl_index_type<uint16_t>() {
+  return GL_UNSIGNED_SHORT;
+}
+
+template<>
+GLenum gl_index_type<uint32_t>() {
+  return GL_UNSIGNED_INT;
+}
+
+// Draw count triangle corners of the current vertex and normal arrays
+template<typename Index>
+static void draw_corners(const Index *corners, size_t count) {
+  GLenum type = gl_index_type<Index>();
+
+  if(!wireframe_mode) {
+    // Render all faces
+    glDrawElements(GL_TRIANGLES, count, type, corners);
+  } else {
+    // Render lines instead of triangle surfaces
+    for(size_t j = 0; j < count; j += 3) {
+      glDrawElements(GL_LINE_LOOP, 3, type, corners + j);
+    }
+  }
+}
+
 void draw_objects() {
   int num_objects = objects.size();
 
   for(int i = 0; i < num_objects; ++i) {
+    if (object_status[i].state == LoadedObject::BOUNDED) {
+      draw_bounding_box(object_status[i]);
+    }
+    if (object_status[i].state != LoadedObject::READY) {
+      continue;
+    }
+
     // Keep a copy of Modelview Matrix before modifying
     glPushMatrix();
     {
@@ -149,19 +203,14 @@ void draw_objects() {
       glMaterialf(GL_FRONT, GL_SHININESS, objects[i].shininess);
 
       // Tell OpenGL to render geometry for us
-      glVertexPointer(3, GL_FLOAT, 0, &objects[i].vertex_buffer[0]);
+      glVertexPointer(3, GL_FLOAT, 0, &objects[i].vertices[0]);
       glNormalPointer(GL_FLOAT, 0, &objects[i].normal_buffer[0]);
 
-      int buffer_size = objects[i].vertex_buffer.size();
-
-      if(!wireframe_mode) {
-        // Render all faces
-        glDrawArrays(GL_TRIANGLES, 0, buffer_size);
+      const IndexBuffer &corners = objects[i].index_buffer;
+      if (corners.is_short()) {
+        draw_corners(corners.get<uint16_t>(), corners.size());
       } else {
-        // Render lines instead of triangle surfaces
-        for(int j = 0; j < buffer_size; j += 3) {
-          glDrawArrays(GL_LINE_LOOP, j, 3);
-        }
+        draw_corners(corners.get<uint32_t>(), corners.size());
       }
     }
     // Get original matrix without transformation back
@@ -169,6 +218,250 @@ void draw_objects() {
   }
 }
 
+void draw_bounding_box(const LoadedObject &object) {
+  const Vertex &lo = object.min_corner;
+  const Vertex &hi = object.max_corner;
+
+  // Unlit grey lines so the box reads as a placeholder
+  glDisable(GL_LIGHTING);
+  glColor3f(0.5, 0.5, 0.5);
+  glBegin(GL_LINES);
+  for (int axis = 0; axis < 3; ++axis) {
+    // Four edges parallel to each axis
+    for (int corner = 0; corner < 4; ++corner) {
+      float a[3], b[3];
+      float u = (corner & 1) ? 1 : 0;
+      float v = (corner & 2) ? 1 : 0;
+      float from[3] = {lo.x, lo.y, lo.z};
+      float size[3] = {hi.x - lo.x, hi.y - lo.y, hi.z - lo.z};
+      int axis_u = (axis + 1) % 3;
+      int axis_v = (axis + 2) % 3;
+
+      a[axis] = from[axis];
+      b[axis] = from[axis] + size[axis];
+      a[axis_u] = b[axis_u] = from[axis_u] + u * size[axis_u];
+      a[axis_v] = b[axis_v] = from[axis_v] + v * size[axis_v];
+
+      glVertex3fv(a);
+      glVertex3fv(b);
+    }
+  }
+  glEnd();
+  glEnable(GL_LIGHTING);
+}
+
+void poll_scene_loader(int value) {
+  string error_message;
+  try {
+    if (scene_loader->poll(objects, object_status)) {
+      glutPostRedisplay();
+    }
+  } catch (const exception &error) {
+    error_message = error.what();
+  } catch (const char *message) {
+    error_message = message;
+  }
+
+  if (!error_message.empty()) {
+    cerr << error_message << endl;
+    if (!reloading && !lazy_mode) {
+      exit(-1);
+    }
+    if (!reloading) {
+      // Lazy batches keep going without the copies that did not load, so
+      // they are not retried every tick
+      for (size_t j = 0; j < lazy_batch.size(); ++j) {
+        if (object_status[lazy_batch[j]].state != LoadedObject::READY) {
+          load_failed[lazy_batch[j]] = true;
+        }
+      }
+    }
+    // A broken save keeps the copies from before it on screen
+    scene_loader.reset();
+    reloading = false;
+    return;
+  }
+
+  if (scene_loader->done()) {
+    scene_loader.reset();
+    // Lazy mode loads small batches all the time, no need to announce them
+    if (reloading) {
+      cout << "Done reloading" << endl;
+    } else if (!lazy_mode) {
+      cout << "Done loading" << endl;
+      report_load_allocations();
+    }
+    reloading = false;
+  } else {
+    glutTimerFunc(load_poll_ms, poll_scene_loader, 0);
+  }
+}
+
+void report_load_allocations() {
+  AllocationCount used = allocations_since(load_allocations);
+  size_t bytes = 0;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    bytes += objects[i].memory_bytes();
+  }
+
+  double megabytes = bytes / (1024.0 * 1024.0);
+  streamsize precision = cout.precision(3);
+  cout << "Loaded " << megabytes << " MB with " << used.allocations
+       << " allocations";
+  if (megabytes > 0) {
+    cout << " (" << (size_t) (used.allocations / megabytes) << " per MB)";
+  }
+  cout << endl;
+  cout.precision(precision);
+}
+
+void poll_mesh_watcher(int value) {
+  vector<int> changed = mesh_watcher->changed_meshes();
+  pending_reloads.insert(pending_reloads.end(), changed.begin(), changed.end());
+
+  // Changes seen during a load wait for it to finish
+  if (!pending_reloads.empty() && !scene_loader) {
+    start_reload();
+  }
+  glutTimerFunc(watch_poll_ms, poll_mesh_watcher, 0);
+}
+
+void start_reload() {
+  sort(pending_reloads.begin(), pending_reloads.end());
+  pending_reloads.erase(unique(pending_reloads.begin(), pending_reloads.end()),
+      pending_reloads.end());
+
+  for (size_t i = 0; i < pending_reloads.size(); ++i) {
+    const SceneMesh &mesh = scene.meshes[pending_reloads[i]];
+    cout << "Reloading " << mesh.file_name << endl;
+    forget_shared_mesh(scene_mesh_path(mesh), scene.load_options);
+  }
+
+  // Only the copies of the changed meshes are rebuilt, everything else
+  // (and the camera) stays as it is
+  vector<size_t> copies = find_mesh_instances(scene, pending_reloads);
+  pending_reloads.clear();
+
+  if (lazy_mode) {
+    // Copies not loaded right now read the new file when they are needed,
+    // their box may have changed with it
+    for (size_t j = 0; j < copies.size(); ++j) {
+      load_failed[copies[j]] = false;
+    }
+    start_bounds_loader(copies);
+    copies.erase(remove_if(copies.begin(), copies.end(), [](size_t i) {
+      return object_status[i].state != LoadedObject::READY;
+    }), copies.end());
+    if (copies.empty()) {
+      return;
+    }
+  }
+
+  reloading = true;
+  scene_loader = shared_ptr<SceneLoader>(new SceneLoader(scene, copies));
+  scene_loader->start();
+  glutTimerFunc(load_poll_ms, poll_scene_loader, 0);
+}
+
+void start_bounds_loader(const vector<size_t> &copies) {
+  vector<size_t> unloaded;
+  for (size_t j = 0; j < copies.size(); ++j) {
+    if (object_status[copies[j]].state != LoadedObject::READY) {
+      object_status[copies[j]].state = LoadedObject::ESTIMATING;
+      unloaded.push_back(copies[j]);
+    }
+  }
+  if (unloaded.empty()) {
+    return;
+  }
+
+  shared_ptr<SceneBoundsLoader> loader(new SceneBoundsLoader(scene, unloaded));
+  loader->start();
+  bounds_loaders.push_back(loader);
+}
+
+void update_object_visibility() {
+  double projection[16], modelview[16], view[16];
+  glGetDoublev(GL_PROJECTION_MATRIX, projection);
+  glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+  multiply_view(projection, modelview, view);
+
+  object_budget->next_frame();
+  for (size_t i = 0; i < objects.size(); ++i) {
+    const LoadedObject &status = object_status[i];
+    // A copy whose file gave no box could be anywhere, so it counts as in
+    // view until it has been loaded once (the budget can unload it again
+    // after that). One still waiting for its box is left alone.
+    bool in_view;
+    if (status.state == LoadedObject::ESTIMATING) {
+      in_view = false;
+    } else {
+      in_view = (status.state == LoadedObject::PENDING)
+        || box_in_view(view, status.min_corner, status.max_corner);
+    }
+
+    object_in_view[i] = in_view;
+    if (in_view) {
+      object_budget->touch(i);
+    }
+  }
+}
+
+void poll_lazy_objects(int value) {
+  // Boxes of unloaded copies, later loaders after earlier ones so the
+  // newest box of a changed file wins
+  bool new_boxes = false;
+  for (size_t j = 0; j < bounds_loaders.size(); ++j) {
+    new_boxes = bounds_loaders[j]->poll(object_status) || new_boxes;
+  }
+  bounds_loaders.erase(remove_if(bounds_loaders.begin(), bounds_loaders.end(),
+        [](const shared_ptr<SceneBoundsLoader> &loader) {
+      return loader->done();
+    }), bounds_loaders.end());
+  if (new_boxes) {
+    glutPostRedisplay();
+  }
+
+  // Count the copies the loader finished since the last tick
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (object_status[i].state == LoadedObject::READY
+        && !object_budget->is_loaded(i)) {
+      object_budget->loaded(i, objects[i].memory_bytes());
+    }
+  }
+
+  // Unloaded copies keep their box and are drawn as one
+  vector<size_t> evicted = object_budget->evict();
+  for (size_t j = 0; j < evicted.size(); ++j) {
+    objects[evicted[j]] = Model();
+    object_status[evicted[j]].state = LoadedObject::BOUNDED;
+  }
+  if (!evicted.empty()) {
+    glutPostRedisplay();
+  }
+
+  // One batch at a time, copies that come into view meanwhile go next
+  if (!scene_loader) {
+    vector<size_t> wanted;
+    for (size_t i = 0; i < objects.size(); ++i) {
+      if (object_status[i].state != LoadedObject::READY
+          && ((object_in_view[i] && !load_failed[i]) || load_requested[i])) {
+        wanted.push_back(i);
+        load_requested[i] = false;
+        load_failed[i] = false;
+      }
+    }
+
+    if (!wanted.empty()) {
+      lazy_batch = wanted;
+      scene_loader = shared_ptr<SceneLoader>(new SceneLoader(scene, wanted));
+      scene_loader->start();
+      glutTimerFunc(load_poll_ms, poll_scene_loader, 0);
+    }
+  }
+  glutTimerFunc(load_poll_ms, poll_lazy_objects, 0);
+}
+
 void mouse_pressed(int button, int state, int x, int y) {
   // If left mouse clicked down
   if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
@@ -206,18 +499,29 @@ void mouse_moved(int x, int y) {
 
 void key_pressed(unsigned char key, int x, int y) {
   if(key == 'q') {
+    // Stop the background loaders before the globals they use go away
+    scene_loader.reset();
+    bounds_loaders.clear();
     // Quit the program.
     exit(0);
   } else if(key == 't') {
     // Toggle wireframe mode
     wireframe_mode = !wireframe_mode;
     glutPostRedisplay();
+  } else if (key == 'l' && lazy_mode) {
+    // Load every copy, the budget still unloads the ones out of view
+    load_requested.assign(load_requested.size(), true);
+  } else if ((key == 'f' || key == 'e') && scene_loader) {
+    cout << "Still loading, try again once loading is done" << endl;
   } else if (key == 'f') {
     // Apply implicit_fairing
     cout << "Smoothing image..." << endl;
     implicit_fairing(objects, time_step);
     glutPostRedisplay();
     cout << "Done smoothing" << endl;
+  } else if (key == 'e') {
+    // Export every object as it is now (e.g. after smoothing)
+    export_objects();
   } else {
     float x_view_rad = deg2rad(x_view_angle);
 
@@ -245,6 +549,21 @@ void key_pressed(unsigned char key, int x, int y) {
   }
 }
 
+void export_objects() {
+  for (size_t i = 0; i < objects.size(); ++i) {
+    // Copies not loaded right now (-lazy) have nothing to write
+    if (object_status[i].state != LoadedObject::READY) {
+      continue;
+    }
+    string file_name = objects[i].name + ".obj";
+    if (write_mesh_file(file_name, objects[i])) {
+      cout << "Wrote " << file_name << endl;
+    } else {
+      cerr << "Could not write " << file_name << endl;
+    }
+  }
+}
+
 float deg2rad(float angle) {
   return angle * M_PI / 180.0;
 }
@@ -253,11 +572,51 @@ float rad2deg(float angle) {
   return angle * 180.0 / M_PI;
 }
 
+bool parse_flags(int num_flags, char **flags, RenderFlags &render_flags) {
+  MeshLoadOptions &options = render_flags.load_options;
+  for (int i = 0; i < num_flags; ++i) {
+    string flag = flags[i];
+    if (flag == "-watch") {
+      render_flags.watch = true;
+    } else if (flag == "-weld" && i + 1 < num_flags) {
+      char *end;
+      options.weld = true;
+      options.weld_epsilon = strtof(flags[++i], &end);
+      if (*end != '\0' || !(options.weld_epsilon >= 0)) {
+        return false;
+      }
+    } else if (flag == "-reorder" && i + 1 < num_flags) {
+      string ordering = flags[++i];
+      if (ordering == ordering_name(ORDER_MORTON)) {
+        options.ordering = ORDER_MORTON;
+      } else if (ordering == ordering_name(ORDER_RCM)) {
+        options.ordering = ORDER_RCM;
+      } else {
+        return false;
+      }
+    } else if (flag == "-lazy" && i + 1 < num_flags) {
+      char *end;
+      double budget_mb = strtod(flags[++i], &end);
+      if (*end != '\0' || !(budget_mb >= 0)) {
+        return false;
+      }
+      render_flags.lazy = true;
+      render_flags.lazy_budget = budget_mb * 1024 * 1024;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
 int main(int argc, char* argv[]) {
   // Parse arguments
-  if (argc != 5) {
+  RenderFlags flags;
+  if (argc < 5 || !parse_flags(argc - 5, argv + 5, flags)) {
     cerr << "usage: " << argv[0]
-         << " [scene_description_file.txt] [xres] [yres] [h]" << endl;
+         << " [scene_description_file.txt] [xres] [yres] [h]"
+         << " [-weld epsilon] [-reorder morton|rcm] [-watch]"
+         << " [-lazy budget_mb]" << endl;
     exit(-1);
   }
   char *file_name = argv[1];
@@ -265,14 +624,52 @@ int main(int argc, char* argv[]) {
   yres = atoi(argv[3]);
   time_step = atof(argv[4]);
 
-  // Parse camera parameters
-  cam = parse_camera_data(file_name);
-
-  // Get lights as vector<Light>
-  lights = parse_light_data(file_name);
+  // Eigen sets up shared state lazily, do it before loading in parallel
+  Eigen::initParallel();
+
+  try {
+    load_allocations = allocation_count();
+
+    // Read camera, lights, objects and copies in one pass
+    scene = load_scene(file_name);
+    scene.load_options = flags.load_options;
+    cam = scene.camera;
+    lights = scene.lights;
+
+    // Parse model data and create geo-transformed copies with material
+    // props in the background, they appear as they are ready
+    objects.resize(scene.instances.size());
+    object_status.resize(scene.instances.size());
+    if (flags.lazy) {
+      // Nothing is loaded until it comes into view
+      lazy_mode = true;
+      object_budget = shared_ptr<ObjectBudget>(
+          new ObjectBudget(scene.instances.size(), flags.lazy_budget));
+      object_in_view.resize(scene.instances.size());
+      load_requested.resize(scene.instances.size());
+      load_failed.resize(scene.instances.size());
+      vector<size_t> copies(scene.instances.size());
+      for (size_t i = 0; i < copies.size(); ++i) {
+        copies[i] = i;
+      }
+      // Boxes from the mesh caches (or one pass over each .obj) come in
+      // the background, copies out of view then stay unloaded
+      start_bounds_loader(copies);
+    } else {
+      scene_loader = shared_ptr<SceneLoader>(new SceneLoader(scene));
+      scene_loader->start();
+    }
 
-  // Parse model data and create geo-transformed copies with material props
-  objects = store_obj_transform_file(file_name);
+    if (flags.watch) {
+      mesh_watcher = shared_ptr<MeshWatcher>(new MeshWatcher(scene));
+    }
+  } catch (const SceneError &error) {
+    cerr << error.what() << endl;
+    exit(-1);
+  } catch (const char *message) {
+    cerr << message << endl;
+    exit(-1);
+  }
 
   // Initialize GLUT library
   glutInit(&argc, argv);
@@ -290,6 +687,14 @@ int main(int argc, char* argv[]) {
   glutMouseFunc(mouse_pressed);
   glutMotionFunc(mouse_moved);
   glutKeyboardFunc(key_pressed);
+  if (lazy_mode) {
+    glutTimerFunc(load_poll_ms, poll_lazy_objects, 0);
+  } else {
+    glutTimerFunc(load_poll_ms, poll_scene_loader, 0);
+  }
+  if (mesh_watcher) {
+    glutTimerFunc(watch_poll_ms, poll_mesh_watcher, 0);
+  }
 
   // Keep doing display, reshape, mouse, and keyboard functions
   glutMainLoop();
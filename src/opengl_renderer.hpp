@@ -10,9 +10,15 @@
 #include <iostream>
 #include <vector>
 
+#include "alloc_counter.hpp"
 #include "arcball.hpp"
 #include "camera.hpp"
+#include "lazy_loading.hpp"
+#include "load_options.hpp"
+#include "mesh_watcher.hpp"
 #include "parser.hpp"
+#include "scene.hpp"
+#include "scene_loader.hpp"
 #include "transform_obj.hpp"
 #include "model.hpp"
 #include "structs.hpp"
@@ -34,6 +40,25 @@ void init_lights();
 void set_lights();
 // This function has OpenGL render our objects to the display screen.
 void draw_objects();
+// Outline of a copy whose buffers are still being built
+void draw_bounding_box(const LoadedObject &object);
+
+// Timer callback that picks up copies finished by the background loader
+void poll_scene_loader(int value);
+// Print the allocations made since load_allocations per MB of objects
+void report_load_allocations();
+// Timer callback that reloads mesh files changed on disk (-watch)
+void poll_mesh_watcher(int value);
+// Rebuild the copies of the meshes in pending_reloads in the background
+void start_reload();
+// Mark the copies in copies that are not loaded ESTIMATING and work out
+// their boxes in the background (-lazy)
+void start_bounds_loader(const vector<size_t> &copies);
+// Test every copy against the current view and mark the ones in it (-lazy)
+void update_object_visibility();
+// Timer callback that loads copies in view and unloads copies over the
+// budget (-lazy)
+void poll_lazy_objects(int value);
 
 // Respond to mouse clicks and releases
 void mouse_pressed(int button, int state, int x, int y);
@@ -41,11 +66,26 @@ void mouse_pressed(int button, int state, int x, int y);
 void mouse_moved(int x, int y);
 // Respond to key pressed on the keyboard.
 void key_pressed(unsigned char key, int x, int y);
+// Write each object to <name>.obj ('e' key)
+void export_objects();
 
 // Convert between degrees and radians
 float deg2rad(float angle);
 float rad2deg(float angle);
 
+// Optional flags after the four arguments
+struct RenderFlags {
+  MeshLoadOptions load_options;
+  bool watch;
+  bool lazy;
+  size_t lazy_budget; // bytes
+
+  RenderFlags() : watch(false), lazy(false), lazy_budget(0) {}
+};
+
+// Read the optional flags after the four arguments, false if one is bad
+bool parse_flags(int num_flags, char **flags, RenderFlags &render_flags);
+
 int main(int argc, char* argv[]);
 
 int xres, yres;
@@ -62,6 +102,38 @@ CameraPtr cam;
 vector<Light> lights;
 vector<Model> objects;
 
+// Copies are built in the background after the window opens, objects[i]
+// can only be drawn once object_status[i] is READY
+shared_ptr<SceneLoader> scene_loader;
+vector<LoadedObject> object_status;
+const int load_poll_ms = 50;
+// Allocation count when the first load started
+AllocationCount load_allocations;
+
+// The scene as read from the file, kept to rebuild copies in watch mode
+Scene scene;
+// Set in watch mode, meshes whose files changed wait in pending_reloads
+// until no load is running
+shared_ptr<MeshWatcher> mesh_watcher;
+vector<int> pending_reloads;
+bool reloading = false;
+const int watch_poll_ms = 250;
+
+// Set in lazy mode: copies are loaded once they are in view or asked for
+// ('l') and unloaded again, least recently in view first, while the loaded
+// ones hold more than the budget. Unloaded copies are drawn as their box.
+bool lazy_mode = false;
+shared_ptr<ObjectBudget> object_budget;
+// Per copy: in view in the last frame, asked for, and whether the batch
+// loading it failed (not tried again until asked for or its file changes)
+vector<bool> object_in_view;
+vector<bool> load_requested;
+vector<bool> load_failed;
+// Copies the running loader was started for (-lazy)
+vector<size_t> lazy_batch;
+// Background work on the boxes of unloaded copies, oldest first (-lazy)
+vector<shared_ptr<SceneBoundsLoader> > bounds_loaders;
+
 int mouse_x, mouse_y;
 float mouse_scale_x, mouse_scale_y;
 
@@ -0,0 +1,118 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+unsigned int num_worker_threads() {
+  // NUM_THREADS overrides the core count, e.g. for scaling measurements
+  const char *requested = getenv("NUM_THREADS");
+  if (requested != NULL && atoi(requested) > 0) {
+    return atoi(requested);
+  }
+
+  unsigned int threads = thread::hardware_concurrency();
+  return (threads == 0) ? 1 : threads;
+}
+
+// Threads started by parallel_for calls that are still running, across
+// every call in the process. A loop only starts threads while the total
+// stays under num_worker_threads(), so a loop nested inside another (e.g. a
+// big file parsed while loading a scene) gets whatever cores the outer loop
+// leaves idle instead of oversubscribing them.
+static atomic<size_t> running_threads(0);
+
+// Reserve up to wanted more threads, returns how many were granted
+static size_t reserve_threads(size_t wanted, size_t limit) {
+  size_t running = running_threads.load();
+  size_t granted;
+  do {
+    granted = (running >= limit) ? 0 : limit - running;
+    if (granted > wanted) {
+      granted = wanted;
+    }
+  } while (granted > 0 &&
+      !running_threads.compare_exchange_weak(running, running + granted));
+  return granted;
+}
+
+void parallel_for(size_t count, const function<void(size_t)> &body) {
+  size_t max_threads = num_worker_threads();
+  size_t num_threads = max_threads;
+  if (num_threads > count) {
+    num_threads = count;
+  }
+
+  // The calling thread is one of the worker threads, so a loop can start
+  // one fewer than the limit
+  size_t num_extra = (num_threads <= 1) ? 0 :
+    reserve_threads(num_threads - 1, max_threads - 1);
+
+  // Not worth starting threads for a single item, and every core is busy
+  // if none could be reserved
+  if (num_extra == 0) {
+    for (size_t i = 0; i < count; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  atomic<size_t> next_item(0);
+  exception_ptr error;
+  mutex error_mutex;
+
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next_item++) < count) {
+      try {
+        body(i);
+      } catch (...) {
+        lock_guard<mutex> lock(error_mutex);
+        if (!error) {
+          error = current_exception();
+        }
+        // Stop handing out work
+        next_item = count;
+      }
+    }
+  };
+
+  // Each started thread gives its slot back as soon as it runs out of
+  // items, so nested loops still running elsewhere can use the core
+  auto extra_worker = [&]() {
+    worker();
+    --running_threads;
+  };
+
+  vector<thread> threads;
+  for (size_t t = 0; t < num_extra; ++t) {
+    threads.push_back(thread(extra_worker));
+  }
+  // The calling thread does its share too
+  worker();
+
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+void parallel_chunks(size_t count, size_t chunk,
+    const function<void(size_t, size_t)> &body) {
+  size_t num_chunks = (count + chunk - 1) / chunk;
+  parallel_for(num_chunks, [&](size_t i) {
+    size_t begin = i * chunk;
+    body(begin, min(count, begin + chunk));
+  });
+}
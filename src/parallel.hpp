@@ -0,0 +1,25 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+// Number of threads to spread work over (at least 1), the NUM_THREADS
+// environment variable overrides the hardware thread count
+unsigned int num_worker_threads();
+
+// Call body(i) for every i in [0, count), spread over the worker threads.
+// Items are handed out one at a time so uneven items still balance. The
+// first exception thrown by body is rethrown on the calling thread.
+// Calls made from inside a body only use the threads other loops leave
+// idle, and run serially on that thread if there are none.
+void parallel_for(size_t count, const function<void(size_t)> &body);
+
+// Call body(begin, end) for the pieces of [0, count) chunk items long,
+// spread over the worker threads with parallel_for
+void parallel_chunks(size_t count, size_t chunk,
+    const function<void(size_t, size_t)> &body);
+
+#endif
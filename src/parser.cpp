@@ -1,5 +1,6 @@
 #include "parser.hpp"
 
+#include <cctype>
 #include <fstream> // basic file operations
 #include <iostream>
 #include <map>
@@ -8,10 +9,24 @@
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
 #include "camera.hpp"
+#include "compact_mesh.hpp"
+#include "gzip_input.hpp"
+#include "load_options.hpp"
 #include "model.hpp" // .obj file data stored in model
+#include "mesh_cache.hpp"
+#include "mesh_library.hpp"
+#include "mesh_stream.hpp"
 #include "model_transform.hpp"
+#include "obj_parser.hpp"
+#include "parallel.hpp"
+#include "ply_parser.hpp"
+#include "reorder.hpp"
+#include "scene.hpp"
 #include "structs.hpp"
+#include "weld.hpp"
 
 using namespace std;
 
@@ -19,45 +34,7 @@ using CameraPtr = shared_ptr<Camera>;
 using ReflectPtr = shared_ptr<Reflectance>;
 using ModelTransformPtr = shared_ptr<ModelTransform>;
 
-CameraPtr parse_camera_data(char *file_name) {
-  ifstream obj_transform_file(file_name);
-  return get_camera_data(obj_transform_file);
-}
-
-vector<Light> parse_light_data(char *file_name) {
-  ifstream obj_transform_file(file_name);
-  get_camera_data(obj_transform_file);
-  return get_light_data(obj_transform_file);
-}
-
-CameraPtr get_camera_data(ifstream& obj_transform_file) {
-  vector<string> lines;
-  string line;
-
-  getline(obj_transform_file, line);
-  while (line != "") {
-    lines.push_back(line);
-    getline(obj_transform_file, line);
-  }
-
-  CameraPtr cam = CameraPtr(new Camera(lines));
-  return cam;
-}
-
-vector<Light> get_light_data(ifstream& obj_transform_file) {
-  vector<Light> lights = vector<Light>();
-  string line;
-
-  getline(obj_transform_file, line);
-  while (line != "") {
-    lights.push_back(store_light_line(line));
-    getline(obj_transform_file, line);
-  }
-
-  return lights;
-}
-
-Light store_light_line(string line) {
+Light store_light_line(const string &line) {
   istringstream line_stream(line);
   string light;
   char comma1, comma2;
@@ -71,28 +48,111 @@ Light store_light_line(string line) {
 
 vector<Model> store_file_objects(int argc, char **argv) {
   vector<Model> models = vector<Model>();
+  models.reserve(argc > 1 ? argc - 1 : 0);
 
   for (int i = 1; i < argc; i++) {
-    Model model = parse_file_to_model(string(argv[i]));
-    models.push_back(model);
+    models.push_back(parse_file_to_model(argv[i]));
   }
 
   return models;
 }
 
-Model parse_file_to_model(string file_name) {
-  ifstream obj_file(file_name);
+Model parse_file_to_model(const string &file_name,
+    const MeshLoadOptions &options) {
   Model model = Model(file_name);
 
-  string line;
-  while (getline(obj_file, line)) {
-    store_obj_line(line, model);
+  // A fresh binary cache skips text parsing (welding, reordering) entirely
+  if (load_mesh_cache(file_name, model, options)) {
+    return model;
+  }
+
+  // Missing files give an empty model, same as reading a failed ifstream
+  if (!parse_mesh_file(file_name, model)) {
+    return model;
+  }
+
+  if (options.weld) {
+    weld_vertices(model, options.weld_epsilon);
+  }
+
+  if (options.ordering != ORDER_FILE) {
+    ReorderStats stats = reorder_mesh(model, options.ordering);
+    // One write, so lines from parallel loads do not interleave
+    ostringstream report;
+    report << "Reordered " << file_name << " ("
+      << ordering_name(options.ordering) << "): bandwidth "
+      << stats.bandwidth_before << " -> " << stats.bandwidth_after
+      << ", neighbour sweep " << stats.sweep_before * 1e3 << " -> "
+      << stats.sweep_after * 1e3 << " ms\n";
+    cout << report.str() << flush;
   }
 
+  // Compact meshes decode about as fast as the cache loads, so skip it
+  // unless welding or reordering made the cache worth having
+  if (!has_extension(file_name, ".cmesh") || options.weld
+      || options.ordering != ORDER_FILE) {
+    // Best effort, the data directory may be read only
+    save_mesh_cache(file_name, model, options);
+  }
   return model;
 }
 
-MaterialPtr store_material_properties(vector<string> lines) {
+bool mesh_file_bounds(const string &file_name, const MeshLoadOptions &options,
+    Vertex &min_corner, Vertex &max_corner) {
+  if (load_mesh_cache_bounds(file_name, min_corner, max_corner, options)) {
+    return true;
+  }
+
+  // The other formats would have to be loaded in full
+  if (has_extension(file_name, ".ply") || has_extension(file_name, ".ply.gz")
+      || has_extension(file_name, ".cmesh")
+      || has_extension(file_name, ".cmesh.gz")) {
+    return false;
+  }
+
+  // Welding only drops vertices and reordering renumbers them, so the box
+  // of the file as written still holds
+  MeshStats stats;
+  if (!compute_mesh_stats(file_name, stats)) {
+    return false;
+  }
+  if (stats.num_vertices == 0) {
+    // Same as Model::get_bounds of an empty mesh
+    min_corner = Vertex();
+    max_corner = Vertex();
+  } else {
+    min_corner = stats.min_corner;
+    max_corner = stats.max_corner;
+  }
+  return true;
+}
+
+bool has_extension(const string &file_name, const string &extension) {
+  if (file_name.size() < extension.size()) {
+    return false;
+  }
+
+  string tail = file_name.substr(file_name.size() - extension.size());
+  for (size_t i = 0; i < tail.size(); ++i) {
+    tail[i] = tolower(tail[i]);
+  }
+  return tail == extension;
+}
+
+bool parse_mesh_file(const string &file_name, Model &model) {
+  if (is_gzip_file(file_name)) {
+    return parse_gzip_mesh_file(file_name, model);
+  }
+  if (has_extension(file_name, ".ply")) {
+    return parse_ply_file(file_name, model);
+  }
+  if (has_extension(file_name, ".cmesh")) {
+    return parse_compact_mesh_file(file_name, model);
+  }
+  return parse_obj_file(file_name, model);
+}
+
+MaterialPtr store_material_properties(const vector<string> &lines) {
   MaterialPtr material = MaterialPtr(new Material());
 
   store_ambient_prop(lines, material);
@@ -103,8 +163,9 @@ MaterialPtr store_material_properties(vector<string> lines) {
   return material;
 }
 
-void store_ambient_prop(vector<string> lines, MaterialPtr material) {
-  string line = lines[0];
+void store_ambient_prop(const vector<string> &lines,
+    const MaterialPtr &material) {
+  const string &line = lines[0];
 
   istringstream line_stream(line);
   string _;
@@ -116,8 +177,9 @@ void store_ambient_prop(vector<string> lines, MaterialPtr material) {
   material->ambient = ReflectPtr(new Reflectance(r, g, b));
 }
 
-void store_diffuse_prop(vector<string> lines, MaterialPtr material) {
-  string line = lines[1];
+void store_diffuse_prop(const vector<string> &lines,
+    const MaterialPtr &material) {
+  const string &line = lines[1];
 
   istringstream line_stream(line);
   string _;
@@ -129,8 +191,9 @@ void store_diffuse_prop(vector<string> lines, MaterialPtr material) {
   material->diffuse = ReflectPtr(new Reflectance(r, g, b));
 }
 
-void store_specular_prop(vector<string> lines, MaterialPtr material) {
-  string line = lines[2];
+void store_specular_prop(const vector<string> &lines,
+    const MaterialPtr &material) {
+  const string &line = lines[2];
 
   istringstream line_stream(line);
   string _;
@@ -142,8 +205,9 @@ void store_specular_prop(vector<string> lines, MaterialPtr material) {
   material->specular = ReflectPtr(new Reflectance(r, g, b));
 }
 
-void store_shininess_prop(vector<string> lines, MaterialPtr material) {
-  string line = lines[3];
+void store_shininess_prop(const vector<string> &lines,
+    const MaterialPtr &material) {
+  const string &line = lines[3];
 
   istringstream line_stream(line);
   string _;
@@ -155,7 +219,7 @@ void store_shininess_prop(vector<string> lines, MaterialPtr material) {
   material->shininess = shiny;
 }
 
-void store_obj_line(string line, Model &model) {
+void store_obj_line(const string &line, Model &model) {
   if (is_vertex_line(line)) {
     store_vertex_line(line, model);
 
@@ -167,15 +231,15 @@ void store_obj_line(string line, Model &model) {
   }
 }
 
-bool is_vertex_line(string line) {
+bool is_vertex_line(const string &line) {
   return line.at(0) == 'v' && line.at(1) == ' ';
 }
 
-bool is_face_line(string line) {
+bool is_face_line(const string &line) {
   return line.at(0) == 'f';
 }
 
-void store_vertex_line(string line, Model &model) {
+void store_vertex_line(const string &line, Model &model) {
   istringstream line_stream(line);
   char _;
   double x, y, z;
@@ -186,7 +250,7 @@ void store_vertex_line(string line, Model &model) {
   model.vertices.push_back(Vertex(x, y, z));
 }
 
-void store_face_line(string line, Model &model) {
+void store_face_line(const string &line, Model &model) {
   istringstream line_stream(line);
   char f;
   int v1, v2, v3;
@@ -197,41 +261,53 @@ void store_face_line(string line, Model &model) {
   model.faces.push_back(Face (v1, v2, v3));
 }
 
-shared_ptr<map<string, ModelTransformPtr>> get_objects(ifstream& obj_transform_file, CameraPtr cam) {
+shared_ptr<map<string, ModelTransformPtr>> get_objects(const Scene &scene) {
   shared_ptr<map<string, ModelTransformPtr>> models =
     shared_ptr<map<string, ModelTransformPtr>>(new map<string, ModelTransformPtr>());
 
-  string line;
-  getline(obj_transform_file, line); // Ignore first line
-  getline(obj_transform_file, line);
-  while (line != "") {
-    create_obj(line, models, cam);
-    getline(obj_transform_file, line);
+  // Files are parsed concurrently, the map is filled afterwards
+  vector<ModelTransformPtr> created(scene.meshes.size());
+  parallel_for(scene.meshes.size(), [&](size_t i) {
+    created[i] = create_obj(scene.meshes[i], scene.camera,
+        scene.load_options);
+  });
+
+  for (size_t i = 0; i < scene.meshes.size(); ++i) {
+    (*models)[scene.meshes[i].name] = created[i];
   }
 
   return models;
 }
 
-void create_obj(string line, shared_ptr<map<string, ModelTransformPtr>> models, CameraPtr cam) {
-  istringstream line_stream(line);
-
-  string obj_name, obj_filename;
-  if (!(line_stream >> obj_name >> obj_filename)) {
-    throw "Wrong number of arguments to object line";
+string resolve_mesh_file(const string &file_name) {
+  // A mesh kept only compressed is found under its plain name too
+  if (access(file_name.c_str(), F_OK) != 0
+      && access((file_name + ".gz").c_str(), F_OK) == 0) {
+    return file_name + ".gz";
   }
+  return file_name;
+}
+
+string scene_mesh_path(const SceneMesh &mesh) {
+  return resolve_mesh_file("data/" + mesh.file_name);
+}
 
-  obj_filename = "data/" + obj_filename;
+ModelTransformPtr create_obj(const SceneMesh &mesh, CameraPtr cam,
+    const MeshLoadOptions &options) {
+  string obj_filename = scene_mesh_path(mesh);
 
-  ModelTransformPtr new_model = create_model(obj_name, obj_filename);
+  ModelTransformPtr new_model = create_model(mesh.name, obj_filename, options);
   new_model->cam = cam;
-  (*models)[obj_name] = new_model;
+  return new_model;
 }
 
-ModelTransformPtr create_model(string obj_name, string obj_filename) {
+ModelTransformPtr create_model(const string &obj_name,
+    const string &obj_filename, const MeshLoadOptions &options) {
   ModelTransformPtr transform_model =
     ModelTransformPtr(new ModelTransform());
 
-  transform_model->model = parse_file_to_model(obj_filename.c_str());
+  // Objects naming the same file share one parsed copy
+  transform_model->model = get_shared_mesh(obj_filename, options);
   transform_model->copy_num = 0;
   transform_model->name = obj_name;
 
@@ -8,8 +8,10 @@
 #include <vector>
 
 #include "camera.hpp"
+#include "load_options.hpp"
 #include "model.hpp" // .obj file data stored in model
 #include "model_transform.hpp"
+#include "scene.hpp"
 #include "structs.hpp"
 
 using namespace std;
@@ -17,48 +19,66 @@ using namespace std;
 using CameraPtr = shared_ptr<Camera>;
 using ModelTransformPtr = shared_ptr<ModelTransform>;
 
-// parse camera and light lines
-CameraPtr parse_camera_data(char *file_name);
-vector<Light> parse_light_data(char *file_name);
-
-// helper functions for parsing camera and light lines
-CameraPtr get_camera_data(ifstream& obj_transform_file);
-vector<Light> get_light_data(ifstream& obj_transform_file);
-
 // adds Light to lights
-Light store_light_line(string line);
+Light store_light_line(const string &line);
 
 // parses multiple .obj files
 vector<Model> store_file_objects(int argc, char **argv);
 
 // store material properties of object copy
-MaterialPtr store_material_properties(vector<string> lines);
-void store_ambient_prop(vector<string> lines, MaterialPtr material);
-void store_diffuse_prop(vector<string> lines, MaterialPtr material);
-void store_specular_prop(vector<string> lines, MaterialPtr material);
-void store_shininess_prop(vector<string> lines, MaterialPtr material);
+MaterialPtr store_material_properties(const vector<string> &lines);
+void store_ambient_prop(const vector<string> &lines,
+    const MaterialPtr &material);
+void store_diffuse_prop(const vector<string> &lines,
+    const MaterialPtr &material);
+void store_specular_prop(const vector<string> &lines,
+    const MaterialPtr &material);
+void store_shininess_prop(const vector<string> &lines,
+    const MaterialPtr &material);
 
 // helper function for parsing one file
-Model parse_file_to_model(string file_name);
+Model parse_file_to_model(const string &file_name,
+    const MeshLoadOptions &options = MeshLoadOptions());
+
+// bounding box of the mesh file_name loads as, without loading it: from
+// its cache if that is fresh, or one streaming pass over an .obj. False if
+// neither works (e.g. an uncached .ply) or the file can not be read.
+bool mesh_file_bounds(const string &file_name, const MeshLoadOptions &options,
+    Vertex &min_corner, Vertex &max_corner);
+
+// parse a .ply, .cmesh or (otherwise) .obj file into model by its extension,
+// gzip compressed files are recognized by their contents
+bool parse_mesh_file(const string &file_name, Model &model);
+// case insensitive check of the end of file_name, extension includes the dot
+bool has_extension(const string &file_name, const string &extension);
 
 // store one line of file as face or vertex
-void store_obj_line(string line, Model &model);
+// (line at a time reference path, parse_file_to_model uses obj_parser)
+void store_obj_line(const string &line, Model &model);
 
 // helper functions for identifying lines of file
-bool is_vertex_line(string line);
-bool is_face_line(string line);
+bool is_vertex_line(const string &line);
+bool is_face_line(const string &line);
 
 // helper functions for storing lines of file
-void store_vertex_line(string line, Model &model);
-void store_face_line(string line, Model &model);
+void store_vertex_line(const string &line, Model &model);
+void store_face_line(const string &line, Model &model);
 
-// helper function to get objects from .obj files
-shared_ptr<map<string, ModelTransformPtr>> get_objects(ifstream& obj_transform_file, CameraPtr cam);
-// helper function to create objects from line and place it in the map
-void create_obj(string line, shared_ptr<map<string, ModelTransformPtr>> models, CameraPtr cam);
+// helper function to get objects from the .obj files named in the scene,
+// the files are parsed in parallel
+shared_ptr<map<string, ModelTransformPtr>> get_objects(const Scene &scene);
+// file_name, or file_name.gz if only the compressed file exists
+string resolve_mesh_file(const string &file_name);
+// file a scene's mesh entry is loaded from (in the data directory)
+string scene_mesh_path(const SceneMesh &mesh);
+// helper function to create object from its scene entry
+ModelTransformPtr create_obj(const SceneMesh &mesh, CameraPtr cam,
+    const MeshLoadOptions &options = MeshLoadOptions());
 // helper function to create new object
-ModelTransformPtr create_model(string obj_name, string obj_filename);
+ModelTransformPtr create_model(const string &obj_name,
+    const string &obj_filename,
+    const MeshLoadOptions &options = MeshLoadOptions());
 // convert from string to char *
-char *convert_to_char_arr(string input_string);
+char *convert_to_char_arr(const string &input_string);
 
 #endif
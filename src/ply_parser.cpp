@@ -0,0 +1,372 @@
+#include "ply_parser.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "model.hpp"
+#include "obj_parser.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+static bool is_little_endian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+}
+
+size_t ply_type_size(PlyType type) {
+  switch (type) {
+    case PLY_INT8: case PLY_UINT8: return 1;
+    case PLY_INT16: case PLY_UINT16: return 2;
+    case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+    case PLY_FLOAT64: return 8;
+  }
+  return 0;
+}
+
+static PlyType parse_ply_type(const string &name) {
+  if (name == "char" || name == "int8") return PLY_INT8;
+  if (name == "uchar" || name == "uint8") return PLY_UINT8;
+  if (name == "short" || name == "int16") return PLY_INT16;
+  if (name == "ushort" || name == "uint16") return PLY_UINT16;
+  if (name == "int" || name == "int32") return PLY_INT32;
+  if (name == "uint" || name == "uint32") return PLY_UINT32;
+  if (name == "float" || name == "float32") return PLY_FLOAT32;
+  if (name == "double" || name == "float64") return PLY_FLOAT64;
+  throw "Unknown property type in .ply header";
+}
+
+PlyHeader parse_ply_header(const char *begin, const char *end) {
+  PlyHeader header;
+  const char *p = begin;
+  bool first_line = true;
+  bool has_format = false;
+
+  while (p < end) {
+    const char *line_end = find_line_end(p, end);
+    string line(p, line_end);
+    p = (line_end < end) ? line_end + 1 : end;
+
+    istringstream line_stream(line);
+    string keyword;
+    line_stream >> keyword;
+
+    if (first_line) {
+      if (keyword != "ply") {
+        throw "Missing ply magic in .ply file";
+      }
+      first_line = false;
+
+    } else if (keyword == "format") {
+      string format;
+      line_stream >> format;
+      if (format == "ascii") {
+        header.format = PLY_ASCII;
+      } else if (format == "binary_little_endian") {
+        header.format = PLY_BINARY_LE;
+      } else if (format == "binary_big_endian") {
+        header.format = PLY_BINARY_BE;
+      } else {
+        throw "Unknown format in .ply header";
+      }
+      has_format = true;
+
+    } else if (keyword == "element") {
+      PlyElement element;
+      if (!(line_stream >> element.name >> element.count)) {
+        throw "Wrong number of arguments to .ply element line";
+      }
+      header.elements.push_back(element);
+
+    } else if (keyword == "property") {
+      if (header.elements.empty()) {
+        throw "Property before element in .ply header";
+      }
+
+      PlyProperty property;
+      string type;
+      if (!(line_stream >> type)) {
+        throw "Wrong number of arguments to .ply property line";
+      }
+
+      property.is_list = type == "list";
+      if (property.is_list) {
+        string count_type, item_type;
+        if (!(line_stream >> count_type >> item_type >> property.name)) {
+          throw "Wrong number of arguments to .ply property line";
+        }
+        property.count_type = parse_ply_type(count_type);
+        property.type = parse_ply_type(item_type);
+      } else {
+        if (!(line_stream >> property.name)) {
+          throw "Wrong number of arguments to .ply property line";
+        }
+        property.type = parse_ply_type(type);
+        property.count_type = property.type;
+      }
+      header.elements.back().properties.push_back(property);
+
+    } else if (keyword == "end_header") {
+      if (!has_format) {
+        throw "Missing format line in .ply header";
+      }
+      header.data_offset = p - begin;
+      return header;
+    }
+    // comment, obj_info and blank lines are ignored
+  }
+
+  throw "Missing end_header in .ply file";
+}
+
+// Reads the values of the body one at a time in either encoding
+class PlyReader {
+  public:
+    PlyReader(const char *begin, const char *end, PlyFormat format)
+      : p(begin), end(end), format(format) {
+      swap_bytes = (format == PLY_BINARY_LE) != is_little_endian();
+    }
+
+    const char *position() const { return p; }
+    void skip_bytes(size_t count) {
+      need(count);
+      p += count;
+    }
+
+    double read_double(PlyType type) {
+      if (format == PLY_ASCII) {
+        float value;
+        p = skip_separators(p);
+        if (!scan_float(p, end, value)) {
+          throw "Bad number in .ply file";
+        }
+        return value;
+      }
+      return read_binary(type);
+    }
+
+    long long read_int(PlyType type) {
+      if (format == PLY_ASCII) {
+        int value;
+        p = skip_separators(p);
+        if (!scan_int(p, end, value)) {
+          throw "Bad integer in .ply file";
+        }
+        return value;
+      }
+      return static_cast<long long>(read_binary(type));
+    }
+
+    void skip_value(PlyType type) {
+      if (format == PLY_ASCII) {
+        read_double(type);
+      } else {
+        skip_bytes(ply_type_size(type));
+      }
+    }
+
+  private:
+    const char *p;
+    const char *end;
+    PlyFormat format;
+    bool swap_bytes;
+
+    void need(size_t count) {
+      if (size_t(end - p) < count) {
+        throw "Unexpected end of .ply file";
+      }
+    }
+
+    const char *skip_separators(const char *s) {
+      while (s < end && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) {
+        ++s;
+      }
+      return s;
+    }
+
+    template <typename T>
+    T load() {
+      need(sizeof(T));
+      unsigned char bytes[sizeof(T)];
+      memcpy(bytes, p, sizeof(T));
+      if (swap_bytes) {
+        reverse(bytes, bytes + sizeof(T));
+      }
+      p += sizeof(T);
+
+      T value;
+      memcpy(&value, bytes, sizeof(T));
+      return value;
+    }
+
+    double read_binary(PlyType type) {
+      switch (type) {
+        case PLY_INT8: return load<int8_t>();
+        case PLY_UINT8: return load<uint8_t>();
+        case PLY_INT16: return load<int16_t>();
+        case PLY_UINT16: return load<uint16_t>();
+        case PLY_INT32: return load<int32_t>();
+        case PLY_UINT32: return load<uint32_t>();
+        case PLY_FLOAT32: return load<float>();
+        case PLY_FLOAT64: return load<double>();
+      }
+      return 0;
+    }
+};
+
+static void skip_property(PlyReader &reader, const PlyProperty &property) {
+  if (!property.is_list) {
+    reader.skip_value(property.type);
+    return;
+  }
+
+  long long count = reader.read_int(property.count_type);
+  for (long long i = 0; i < count; ++i) {
+    reader.skip_value(property.type);
+  }
+}
+
+// Index of the property called name, -1 if element has none
+static int find_property(const PlyElement &element, const char *name) {
+  for (size_t i = 0; i < element.properties.size(); ++i) {
+    if (element.properties[i].name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Vertex elements that are exactly float x, y, z in host byte order match
+// the Vertex struct and are copied as one block
+static bool is_packed_xyz(const PlyElement &element, PlyFormat format) {
+  if (format == PLY_ASCII
+      || (format == PLY_BINARY_LE) != is_little_endian()
+      || element.properties.size() != 3
+      || sizeof(Vertex) != 3 * sizeof(float)) {
+    return false;
+  }
+
+  const char *names[3] = {"x", "y", "z"};
+  for (int i = 0; i < 3; ++i) {
+    const PlyProperty &property = element.properties[i];
+    if (property.is_list || property.type != PLY_FLOAT32
+        || property.name != names[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void read_vertices(PlyReader &reader, const PlyElement &element,
+    PlyFormat format, vector<Vertex> &vertices) {
+  size_t first = vertices.size();
+
+  if (is_packed_xyz(element, format)) {
+    const char *block = reader.position();
+    reader.skip_bytes(element.count * sizeof(Vertex));
+    vertices.resize(first + element.count);
+    if (element.count > 0) {
+      memcpy(&vertices[first], block, element.count * sizeof(Vertex));
+    }
+    return;
+  }
+
+  int x = find_property(element, "x");
+  int y = find_property(element, "y");
+  int z = find_property(element, "z");
+  if (x < 0 || y < 0 || z < 0) {
+    throw "Vertex element without x, y and z in .ply file";
+  }
+
+  vertices.reserve(first + element.count);
+  for (size_t i = 0; i < element.count; ++i) {
+    double coords[3] = {0, 0, 0};
+    for (size_t j = 0; j < element.properties.size(); ++j) {
+      const PlyProperty &property = element.properties[j];
+      int axis = (int(j) == x) ? 0 : (int(j) == y) ? 1 : (int(j) == z) ? 2 : -1;
+      if (axis >= 0 && !property.is_list) {
+        coords[axis] = reader.read_double(property.type);
+      } else {
+        skip_property(reader, property);
+      }
+    }
+    vertices.push_back(Vertex(coords[0], coords[1], coords[2]));
+  }
+}
+
+static void read_faces(PlyReader &reader, const PlyElement &element,
+    vector<Face> &faces) {
+  int list = find_property(element, "vertex_indices");
+  if (list < 0) {
+    list = find_property(element, "vertex_index");
+  }
+  if (list < 0 || !element.properties[list].is_list) {
+    throw "Face element without vertex_indices in .ply file";
+  }
+
+  faces.reserve(faces.size() + element.count);
+  for (size_t i = 0; i < element.count; ++i) {
+    for (size_t j = 0; j < element.properties.size(); ++j) {
+      const PlyProperty &property = element.properties[j];
+      if (int(j) != list) {
+        skip_property(reader, property);
+        continue;
+      }
+
+      long long count = reader.read_int(property.count_type);
+      if (count < 3) {
+        for (long long k = 0; k < count; ++k) {
+          reader.skip_value(property.type);
+        }
+        continue;
+      }
+
+      // .ply indices are 0-based, Model vertices are 1-based
+      int first = reader.read_int(property.type) + 1;
+      int previous = reader.read_int(property.type) + 1;
+      for (long long k = 2; k < count; ++k) {
+        int current = reader.read_int(property.type) + 1;
+        faces.push_back(Face(first, previous, current));
+        previous = current;
+      }
+    }
+  }
+}
+
+void parse_ply_buffer(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces) {
+  PlyHeader header = parse_ply_header(begin, end);
+  PlyReader reader(begin + header.data_offset, end, header.format);
+
+  for (size_t e = 0; e < header.elements.size(); ++e) {
+    const PlyElement &element = header.elements[e];
+
+    if (element.name == "vertex") {
+      read_vertices(reader, element, header.format, vertices);
+    } else if (element.name == "face") {
+      read_faces(reader, element, faces);
+    } else {
+      for (size_t i = 0; i < element.count; ++i) {
+        for (size_t j = 0; j < element.properties.size(); ++j) {
+          skip_property(reader, element.properties[j]);
+        }
+      }
+    }
+  }
+}
+
+bool parse_ply_file(const string &file_name, Model &model) {
+  MappedFile file;
+  if (!file.open(file_name)) {
+    return false;
+  }
+
+  parse_ply_buffer(file.data(), file.end(), model.vertices, model.faces);
+  return true;
+}
@@ -0,0 +1,63 @@
+#ifndef PLY_PARSER_HPP
+#define PLY_PARSER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+/* .ply (Stanford polygon file) reader for ascii, binary_little_endian and
+ * binary_big_endian files.
+ *
+ * Produces the same layout as the .obj parser: 1-indexed vertices with a
+ * filler at index 0 and triangle faces (polygons are split into fans).
+ * Only x, y and z of the vertex element and the vertex index list of the
+ * face element are kept; other properties and elements are skipped.
+ */
+
+enum PlyFormat { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+
+enum PlyType {
+  PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16,
+  PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+struct PlyProperty {
+  string name;
+  PlyType type;
+  // Lists store a count of count_type followed by that many of type
+  bool is_list;
+  PlyType count_type;
+};
+
+struct PlyElement {
+  string name;
+  size_t count;
+  vector<PlyProperty> properties;
+};
+
+struct PlyHeader {
+  PlyFormat format;
+  vector<PlyElement> elements;
+  // Offset of the first byte after "end_header\n"
+  size_t data_offset;
+};
+
+// Size in bytes of one value of type
+size_t ply_type_size(PlyType type);
+
+// Parse the header at the start of [begin, end)
+PlyHeader parse_ply_header(const char *begin, const char *end);
+
+// Parse a whole .ply buffer, appending to vertices and faces
+void parse_ply_buffer(const char *begin, const char *end,
+    vector<Vertex> &vertices, vector<Face> &faces);
+
+// Map file_name and parse it into model, false if it can not be mapped
+bool parse_ply_file(const string &file_name, Model &model);
+
+#endif
@@ -0,0 +1,410 @@
+#include "reorder.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory> // shared_ptr
+#include <utility>
+#include <vector>
+
+#include "load_options.hpp"
+#include "model.hpp"
+#include "parallel.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+// Vertices or faces handed to each parallel_for item
+static const size_t REORDER_CHUNK = 1 << 14;
+
+// Bits of each axis in a Morton code (3 * 21 fit in 64)
+static const int MORTON_BITS = 21;
+
+// Pseudo-peripheral vertex search gives up after this many walks
+static const int MAX_PERIPHERAL_WALKS = 5;
+
+static bool valid_index(int index, size_t num_vertices) {
+  return index >= 1 && size_t(index) <= num_vertices;
+}
+
+/* Which vertices share an edge, as compressed rows: the neighbours of
+ * vertex v (0-based) are neighbours[start[v]] up to
+ * neighbours[start[v + 1]], in increasing order. This is the pattern of F
+ * without its diagonal.
+ */
+struct Adjacency {
+  vector<uint32_t> start;
+  vector<uint32_t> neighbours;
+
+  uint32_t degree(uint32_t v) const {
+    return start[v + 1] - start[v];
+  }
+};
+
+static void build_adjacency(const vector<Face> &faces, size_t num_vertices,
+    Adjacency &adjacency) {
+  vector<uint32_t> &start = adjacency.start;
+  vector<uint32_t> &neighbours = adjacency.neighbours;
+
+  // Every corner of a face gets the other two, counting sorted by corner
+  start.assign(num_vertices + 1, 0);
+  for (size_t f = 0; f < faces.size(); ++f) {
+    start[faces[f].vertex1] += 2;
+    start[faces[f].vertex2] += 2;
+    start[faces[f].vertex3] += 2;
+  }
+  for (size_t v = 0; v < num_vertices; ++v) {
+    start[v + 1] += start[v];
+  }
+  neighbours.resize(start[num_vertices]);
+  {
+    vector<uint32_t> next(start.begin(), start.end() - 1);
+    for (size_t f = 0; f < faces.size(); ++f) {
+      uint32_t a = faces[f].vertex1 - 1;
+      uint32_t b = faces[f].vertex2 - 1;
+      uint32_t c = faces[f].vertex3 - 1;
+      neighbours[next[a]++] = b;
+      neighbours[next[a]++] = c;
+      neighbours[next[b]++] = c;
+      neighbours[next[b]++] = a;
+      neighbours[next[c]++] = a;
+      neighbours[next[c]++] = b;
+    }
+  }
+
+  // Each edge was listed once per face on it
+  vector<uint32_t> length(num_vertices);
+  parallel_chunks(num_vertices, REORDER_CHUNK, [&](size_t first, size_t last) {
+    for (size_t v = first; v < last; ++v) {
+      uint32_t *row = neighbours.data() + start[v];
+      uint32_t *row_end = neighbours.data() + start[v + 1];
+      sort(row, row_end);
+      length[v] = unique(row, row_end) - row;
+    }
+  });
+
+  uint32_t position = 0;
+  for (size_t v = 0; v < num_vertices; ++v) {
+    uint32_t row = start[v];
+    start[v] = position;
+    copy(neighbours.begin() + row, neighbours.begin() + row + length[v],
+        neighbours.begin() + position);
+    position += length[v];
+  }
+  start[num_vertices] = position;
+  neighbours.resize(position);
+}
+
+// Rows are sorted, so the farthest neighbours are at the ends
+static size_t bandwidth(const Adjacency &adjacency) {
+  size_t width = 0;
+  for (size_t v = 0; v + 1 < adjacency.start.size(); ++v) {
+    if (adjacency.degree(v) == 0) {
+      continue;
+    }
+    size_t lowest = adjacency.neighbours[adjacency.start[v]];
+    size_t highest = adjacency.neighbours[adjacency.start[v + 1] - 1];
+    width = max(width, max(v - min(v, lowest), max(v, highest) - v));
+  }
+  return width;
+}
+
+// Time one pass over every vertex's neighbours, reading their positions the
+// way a one-ring walk does. Runs on one thread so orders compare fairly.
+static double time_sweep(const vector<Vertex> &vertices,
+    const Adjacency &adjacency) {
+  chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+  double sum = 0;
+  for (size_t v = 0; v + 1 < adjacency.start.size(); ++v) {
+    for (uint32_t k = adjacency.start[v]; k < adjacency.start[v + 1]; ++k) {
+      const Vertex &neighbour = vertices[adjacency.neighbours[k] + 1];
+      sum += neighbour.x + neighbour.y + neighbour.z;
+    }
+  }
+  // Keeps the loop from being optimized away
+  volatile double result = sum;
+  (void) result;
+
+  return chrono::duration<double>(chrono::steady_clock::now() - begin)
+    .count();
+}
+
+// The low MORTON_BITS bits of value, moved to every third bit
+static uint64_t spread_bits(uint32_t value) {
+  uint64_t x = value & ((1u << MORTON_BITS) - 1);
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+/* Vertices sorted by where they fall on a Morton curve through the
+ * bounding box. Every axis gets the same scale, so the curve's cells stay
+ * cubes on flat meshes too. Ties keep file order.
+ */
+static void morton_order(const Model &model, vector<uint32_t> &order) {
+  size_t num_vertices = model.vertices.size() - 1;
+  Vertex min_corner, max_corner;
+  model.get_bounds(min_corner, max_corner);
+
+  double extent = max(max_corner.x - min_corner.x,
+      max(max_corner.y - min_corner.y, max_corner.z - min_corner.z));
+  double scale = (extent > 0) ? ((1u << MORTON_BITS) - 1) / extent : 0;
+
+  // Code, then vertex so equal codes keep file order
+  vector<pair<uint64_t, uint32_t> > keys(num_vertices);
+  parallel_chunks(num_vertices, REORDER_CHUNK, [&](size_t first, size_t last) {
+    for (size_t v = first; v < last; ++v) {
+      const Vertex &vertex = model.vertices[v + 1];
+      uint64_t x = spread_bits((vertex.x - min_corner.x) * scale);
+      uint64_t y = spread_bits((vertex.y - min_corner.y) * scale);
+      uint64_t z = spread_bits((vertex.z - min_corner.z) * scale);
+      keys[v] = make_pair(x | (y << 1) | (z << 2), uint32_t(v));
+    }
+  });
+  sort(keys.begin(), keys.end());
+
+  order.resize(num_vertices);
+  for (size_t i = 0; i < num_vertices; ++i) {
+    order[i] = keys[i].second;
+  }
+}
+
+/* Reverse Cuthill-McKee. Each component is walked breadth first from a
+ * vertex as far from the rest as can be found cheaply (walk again from the
+ * last vertex reached while that makes the walk deeper, after George and
+ * Liu), adding the neighbours of each vertex in order of increasing
+ * degree. Reversing the whole order at the end keeps the bandwidth and
+ * shrinks the fill of a factorization of F. Unused vertices are components
+ * of their own. The walks depend on the ones before, so this runs on one
+ * thread.
+ */
+static void rcm_order(const Adjacency &adjacency, vector<uint32_t> &order) {
+  size_t num_vertices = adjacency.start.size() - 1;
+  order.clear();
+  order.reserve(num_vertices);
+
+  vector<char> placed(num_vertices, 0);
+  // Which walk last reached each vertex
+  vector<uint32_t> reached(num_vertices, 0);
+  uint32_t walk = 0;
+  vector<uint32_t> queue;
+
+  // Walk the component of root breadth first, return the number of levels
+  // and the vertex of least degree in the last one
+  auto walk_levels = [&](uint32_t root, uint32_t &farthest) {
+    ++walk;
+    queue.assign(1, root);
+    reached[root] = walk;
+    size_t levels = 0;
+    size_t level_begin = 0;
+    while (level_begin < queue.size()) {
+      size_t level_end = queue.size();
+      ++levels;
+      farthest = queue[level_begin];
+      for (size_t i = level_begin; i < level_end; ++i) {
+        uint32_t v = queue[i];
+        if (adjacency.degree(v) < adjacency.degree(farthest)) {
+          farthest = v;
+        }
+        for (uint32_t k = adjacency.start[v]; k < adjacency.start[v + 1];
+            ++k) {
+          uint32_t neighbour = adjacency.neighbours[k];
+          if (reached[neighbour] != walk) {
+            reached[neighbour] = walk;
+            queue.push_back(neighbour);
+          }
+        }
+      }
+      level_begin = level_end;
+    }
+    return levels;
+  };
+
+  vector<uint32_t> next_neighbours;
+  for (size_t first = 0; first < num_vertices; ++first) {
+    if (placed[first]) {
+      continue;
+    }
+
+    uint32_t root = first;
+    uint32_t farthest;
+    size_t levels = walk_levels(root, farthest);
+    for (int i = 1; i < MAX_PERIPHERAL_WALKS && farthest != root; ++i) {
+      uint32_t next_farthest;
+      size_t next_levels = walk_levels(farthest, next_farthest);
+      if (next_levels <= levels) {
+        break;
+      }
+      root = farthest;
+      levels = next_levels;
+      farthest = next_farthest;
+    }
+
+    size_t component_begin = order.size();
+    order.push_back(root);
+    placed[root] = 1;
+    for (size_t i = component_begin; i < order.size(); ++i) {
+      uint32_t v = order[i];
+      next_neighbours.clear();
+      for (uint32_t k = adjacency.start[v]; k < adjacency.start[v + 1]; ++k) {
+        uint32_t neighbour = adjacency.neighbours[k];
+        if (!placed[neighbour]) {
+          placed[neighbour] = 1;
+          next_neighbours.push_back(neighbour);
+        }
+      }
+      sort(next_neighbours.begin(), next_neighbours.end(),
+          [&](uint32_t a, uint32_t b) {
+            uint32_t degree_a = adjacency.degree(a);
+            uint32_t degree_b = adjacency.degree(b);
+            return degree_a < degree_b || (degree_a == degree_b && a < b);
+          });
+      order.insert(order.end(), next_neighbours.begin(),
+          next_neighbours.end());
+    }
+  }
+
+  reverse(order.begin(), order.end());
+}
+
+ReorderStats reorder_mesh(Model &model, MeshOrdering ordering) {
+  ReorderStats stats = {0, 0, 0, 0};
+  size_t num_vertices = model.vertices.empty() ? 0 : model.vertices.size() - 1;
+  vector<Face> &faces = model.faces;
+
+  parallel_chunks(faces.size(), REORDER_CHUNK, [&](size_t first, size_t last) {
+    for (size_t f = first; f < last; ++f) {
+      if (!valid_index(faces[f].vertex1, num_vertices)
+          || !valid_index(faces[f].vertex2, num_vertices)
+          || !valid_index(faces[f].vertex3, num_vertices)) {
+        throw "Face refers to a missing vertex";
+      }
+    }
+  });
+
+  Adjacency adjacency;
+  build_adjacency(faces, num_vertices, adjacency);
+  stats.bandwidth_before = bandwidth(adjacency);
+  stats.sweep_before = time_sweep(model.vertices, adjacency);
+
+  // File (0-based) index of each vertex in the new order
+  vector<uint32_t> order;
+  if (ordering == ORDER_RCM) {
+    rcm_order(adjacency, order);
+  } else if (ordering == ORDER_MORTON && num_vertices > 0) {
+    morton_order(model, order);
+  } else {
+    order.resize(num_vertices);
+    for (size_t i = 0; i < num_vertices; ++i) {
+      order[i] = i;
+    }
+  }
+  vector<uint32_t>().swap(adjacency.neighbours);
+
+  // New (1-based) index of each vertex of the file
+  vector<int> new_index(num_vertices + 1, 0);
+  vector<Vertex> vertices(model.vertices.size());
+  if (!vertices.empty()) {
+    vertices[0] = model.vertices[0];
+  }
+  parallel_chunks(num_vertices, REORDER_CHUNK, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      new_index[order[i] + 1] = i + 1;
+      vertices[i + 1] = model.vertices[order[i] + 1];
+    }
+  });
+  model.vertices.swap(vertices);
+  vector<Vertex>().swap(vertices);
+
+  // Faces follow their smallest corner (counting sort, ties keep their
+  // order) so the faces around a vertex end up near each other too
+  vector<uint32_t> face_start(num_vertices + 2, 0);
+  parallel_chunks(faces.size(), REORDER_CHUNK, [&](size_t first, size_t last) {
+    for (size_t f = first; f < last; ++f) {
+      faces[f].vertex1 = new_index[faces[f].vertex1];
+      faces[f].vertex2 = new_index[faces[f].vertex2];
+      faces[f].vertex3 = new_index[faces[f].vertex3];
+    }
+  });
+  auto smallest = [&](size_t f) {
+    return min(faces[f].vertex1, min(faces[f].vertex2, faces[f].vertex3));
+  };
+  for (size_t f = 0; f < faces.size(); ++f) {
+    ++face_start[smallest(f) + 1];
+  }
+  for (size_t v = 0; v <= num_vertices; ++v) {
+    face_start[v + 1] += face_start[v];
+  }
+  vector<uint32_t> face_order(faces.size());
+  for (size_t f = 0; f < faces.size(); ++f) {
+    face_order[face_start[smallest(f)]++] = f;
+  }
+  vector<Face> sorted_faces(faces.size(), Face(0, 0, 0));
+  parallel_chunks(faces.size(), REORDER_CHUNK, [&](size_t first, size_t last) {
+    for (size_t f = first; f < last; ++f) {
+      sorted_faces[f] = faces[face_order[f]];
+    }
+  });
+  faces.swap(sorted_faces);
+  vector<Face>().swap(sorted_faces);
+
+  build_adjacency(faces, num_vertices, adjacency);
+  stats.bandwidth_after = bandwidth(adjacency);
+  stats.sweep_after = time_sweep(model.vertices, adjacency);
+
+  // Through an earlier reordering back to the file
+  shared_ptr<MeshOrder> file_order(new MeshOrder());
+  file_order->vertices.resize(model.vertices.size());
+  file_order->faces.resize(faces.size());
+  const MeshOrder *earlier = model.original_order.get();
+  if (!file_order->vertices.empty()) {
+    file_order->vertices[0] = 0;
+  }
+  for (size_t i = 0; i < num_vertices; ++i) {
+    uint32_t vertex = order[i] + 1;
+    file_order->vertices[i + 1] = earlier ? earlier->vertices[vertex] : vertex;
+  }
+  for (size_t f = 0; f < faces.size(); ++f) {
+    uint32_t face = face_order[f];
+    file_order->faces[f] = earlier ? earlier->faces[face] : face;
+  }
+  model.original_order = file_order;
+
+  return stats;
+}
+
+void restore_file_order(const Model &model, Model &restored) {
+  restored.name = model.name;
+  if (!model.original_order) {
+    restored.vertices = model.vertices;
+    restored.faces = model.faces;
+    return;
+  }
+
+  const MeshOrder &order = *model.original_order;
+  assert(order.vertices.size() == model.vertices.size()
+      && order.faces.size() == model.faces.size());
+
+  restored.vertices.resize(model.vertices.size());
+  parallel_chunks(model.vertices.size(), REORDER_CHUNK,
+      [&](size_t first, size_t last) {
+    for (size_t v = first; v < last; ++v) {
+      restored.vertices[order.vertices[v]] = model.vertices[v];
+    }
+  });
+
+  restored.faces.assign(model.faces.size(), Face(0, 0, 0));
+  parallel_chunks(model.faces.size(), REORDER_CHUNK,
+      [&](size_t first, size_t last) {
+    for (size_t f = first; f < last; ++f) {
+      const Face &face = model.faces[f];
+      restored.faces[order.faces[f]] = Face(order.vertices[face.vertex1],
+          order.vertices[face.vertex2], order.vertices[face.vertex3]);
+    }
+  });
+}
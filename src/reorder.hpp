@@ -0,0 +1,44 @@
+#ifndef REORDER_HPP
+#define REORDER_HPP
+
+#include <cstddef>
+
+#include "load_options.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+/* Renumbering vertices and faces for cache locality.
+ *
+ * Scans and exports often list vertices in close to random order, so the
+ * one-ring walks of calc_vertex_normal and build_F_operator (and the rows
+ * of F) jump all over memory. reorder_mesh puts neighbouring vertices next
+ * to each other, either along a Morton (Z order) curve through the bounding
+ * box, which only needs the positions, or in reverse Cuthill-McKee order,
+ * which walks the mesh breadth first from a far away vertex and keeps the
+ * bandwidth of the adjacency matrix (and of F) small. Faces are then sorted
+ * by their smallest corner in the new order, ties keeping their order (the
+ * corners themselves are not rotated). The file numbers are kept in
+ * Model::original_order so the mesh can still be written out as it was
+ * read.
+ */
+
+struct ReorderStats {
+  // Largest difference between the indices of two vertices sharing an
+  // edge: the bandwidth of the adjacency matrix, and so of F
+  size_t bandwidth_before, bandwidth_after;
+  // Seconds to visit the neighbours of every vertex once, reading their
+  // positions, in the old and the new order
+  double sweep_before, sweep_after;
+};
+
+// Renumber the vertices and faces of model in ordering and record where
+// they came from in model.original_order. Throws if a face refers to a
+// missing vertex.
+ReorderStats reorder_mesh(Model &model, MeshOrdering ordering);
+
+// The vertices and faces of model in the order they were read in, for
+// writing it back out (a plain copy if model was not reordered)
+void restore_file_order(const Model &model, Model &restored);
+
+#endif
@@ -0,0 +1,231 @@
+#include "scene.hpp"
+
+#include <fstream> // basic file operations
+#include <iterator>
+#include <map>
+#include <memory> // shared_ptr
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "camera.hpp"
+#include "model.hpp"
+#include "parser.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+static string format_scene_error(const string &file_name, int line_number,
+    const string &message) {
+  ostringstream error;
+  error << file_name << ":" << line_number << ": " << message;
+  return error.str();
+}
+
+SceneError :: SceneError(const string &file_name, int line_number,
+    const string &message)
+  : runtime_error(format_scene_error(file_name, line_number, message)),
+    line_number(line_number) {
+}
+
+// Lines holding only whitespace separate blocks
+static bool is_blank_line(const string &line) {
+  return line.find_first_not_of(" \t\r") == string::npos;
+}
+
+static bool is_transform_line(const string &line) {
+  return line[0] == 't' || line[0] == 'r' || line[0] == 's';
+}
+
+// Blocks of the file in the order they appear
+enum SceneSection { CAMERA_BLOCK, LIGHT_BLOCK, OBJECT_BLOCK, INSTANCE_BLOCK };
+
+// Parses each block as soon as its closing blank line is read
+class SceneReader {
+  public:
+    Scene scene;
+
+    SceneReader(const string &file_name) : file_name(file_name) {
+      section = CAMERA_BLOCK;
+      block_start = 1;
+    }
+
+    void add_line(string &line, int line_number) {
+      if (is_blank_line(line)) {
+        end_block(line_number + 1);
+        return;
+      }
+
+      if (block.empty()) {
+        block_start = line_number;
+      }
+      block.push_back(string());
+      block.back().swap(line);
+    }
+
+    void finish() {
+      end_block(0);
+      if (!scene.camera) {
+        throw SceneError(file_name, 1, "Missing camera block");
+      }
+    }
+
+  private:
+    string file_name;
+    SceneSection section;
+    vector<string> block;
+    int block_start;
+    // Mesh name to index in scene.meshes
+    map<string, int> mesh_index;
+
+    void end_block(int next_start) {
+      try {
+        switch (section) {
+          case CAMERA_BLOCK:
+            read_camera();
+            section = LIGHT_BLOCK;
+            break;
+          case LIGHT_BLOCK:
+            read_lights();
+            section = OBJECT_BLOCK;
+            break;
+          case OBJECT_BLOCK:
+            read_objects();
+            section = INSTANCE_BLOCK;
+            break;
+          case INSTANCE_BLOCK:
+            // Extra blank lines between copies are fine
+            if (!block.empty()) {
+              read_instance();
+            }
+            break;
+        }
+      } catch (const char *message) {
+        // The line parsers only know what went wrong, not where
+        throw SceneError(file_name, block_start, message);
+      }
+
+      block.clear();
+      block_start = next_start;
+    }
+
+    void read_camera() {
+      // "camera:" then position, orientation and six perspective lines
+      if (block.size() < 9) {
+        throw SceneError(file_name, block_start, "Camera block is too short");
+      }
+      scene.camera = CameraPtr(new Camera(block));
+    }
+
+    void read_lights() {
+      for (size_t i = 0; i < block.size(); ++i) {
+        try {
+          scene.lights.push_back(store_light_line(block[i]));
+        } catch (const char *message) {
+          throw SceneError(file_name, block_start + i, message);
+        }
+      }
+    }
+
+    void read_objects() {
+      // The first line is the "objects:" header
+      for (size_t i = 1; i < block.size(); ++i) {
+        istringstream line_stream(block[i]);
+        SceneMesh mesh;
+        mesh.line_number = block_start + i;
+        if (!(line_stream >> mesh.name >> mesh.file_name)) {
+          throw SceneError(file_name, mesh.line_number,
+              "Wrong number of arguments to object line");
+        }
+        if (mesh_index.count(mesh.name) != 0) {
+          throw SceneError(file_name, mesh.line_number,
+              "Object " + mesh.name + " is defined twice");
+        }
+        mesh_index[mesh.name] = scene.meshes.size();
+        scene.meshes.push_back(move(mesh));
+      }
+    }
+
+    void read_instance() {
+      // Name, four material lines, then transforms
+      if (block.size() < 5) {
+        throw SceneError(file_name, block_start,
+            "Copy block needs a name and four material lines");
+      }
+
+      SceneInstance instance;
+      instance.line_number = block_start;
+      istringstream name_stream(block[0]);
+      name_stream >> instance.mesh_name;
+      if (mesh_index.count(instance.mesh_name) == 0) {
+        throw SceneError(file_name, block_start,
+            "Unknown object " + instance.mesh_name);
+      }
+      instance.mesh_index = mesh_index[instance.mesh_name];
+
+      // The material lines are not needed in block after this
+      vector<string> material_lines(make_move_iterator(block.begin() + 1),
+          make_move_iterator(block.begin() + 5));
+      try {
+        instance.material = store_material_properties(material_lines);
+      } catch (const char *message) {
+        throw SceneError(file_name, block_start + 1, message);
+      }
+
+      for (size_t i = 5; i < block.size(); ++i) {
+        if (!is_transform_line(block[i])) {
+          throw SceneError(file_name, block_start + i,
+              "Unknown transform line");
+        }
+        instance.transform_lines.push_back(string());
+        instance.transform_lines.back().swap(block[i]);
+      }
+
+      scene.instances.push_back(move(instance));
+    }
+};
+
+Scene load_scene(const string &file_name) {
+  ifstream scene_file(file_name.c_str());
+  if (!scene_file) {
+    throw SceneError(file_name, 0, "Can not open scene file");
+  }
+
+  SceneReader reader(file_name);
+  string line;
+  int line_number = 0;
+  while (getline(scene_file, line)) {
+    reader.add_line(line, ++line_number);
+  }
+  reader.finish();
+
+  // A member is not moved from implicitly, the Scene would be copied
+  return move(reader.scene);
+}
+
+int find_scene_mesh(const Scene &scene, const string &name) {
+  for (size_t i = 0; i < scene.meshes.size(); ++i) {
+    if (scene.meshes[i].name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+vector<size_t> find_mesh_instances(const Scene &scene,
+    const vector<int> &mesh_indices) {
+  vector<bool> wanted(scene.meshes.size(), false);
+  for (size_t i = 0; i < mesh_indices.size(); ++i) {
+    wanted[mesh_indices[i]] = true;
+  }
+
+  vector<size_t> instances;
+  for (size_t i = 0; i < scene.instances.size(); ++i) {
+    if (wanted[scene.instances[i].mesh_index]) {
+      instances.push_back(i);
+    }
+  }
+  return instances;
+}
@@ -0,0 +1,71 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <memory> // shared_ptr
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "camera.hpp"
+#include "load_options.hpp"
+#include "model.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+using CameraPtr = shared_ptr<Camera>;
+
+/* Everything in a scene description file, read in one pass.
+ *
+ * The file is a sequence of blocks separated by blank lines: the camera,
+ * the lights, the "objects:" table of mesh names and files, and then one
+ * block per copy of a mesh giving its material and transforms.
+ */
+
+// One "name file.obj" line of the objects block
+struct SceneMesh {
+  string name;
+  // As written in the scene file, relative to the data directory
+  string file_name;
+  int line_number;
+};
+
+// One copy of a mesh with its own material and transforms
+struct SceneInstance {
+  string mesh_name;
+  // Index of the mesh in Scene::meshes
+  int mesh_index;
+  MaterialPtr material;
+  // Translation, rotation and scaling lines in file order
+  vector<string> transform_lines;
+  int line_number;
+};
+
+struct Scene {
+  CameraPtr camera;
+  vector<Light> lights;
+  vector<SceneMesh> meshes;
+  vector<SceneInstance> instances;
+  // How the mesh files are loaded, not part of the file (command line)
+  MeshLoadOptions load_options;
+};
+
+// Error in a scene file, what() reads "file:line: message"
+class SceneError : public runtime_error {
+  public:
+    int line_number;
+
+    SceneError(const string &file_name, int line_number, const string &message);
+};
+
+// Read file_name once into a Scene, throws SceneError
+Scene load_scene(const string &file_name);
+
+// Index of the mesh called name in scene.meshes, -1 if there is none
+int find_scene_mesh(const Scene &scene, const string &name);
+
+// Indices into scene.instances of the copies of any mesh in mesh_indices
+vector<size_t> find_mesh_instances(const Scene &scene,
+    const vector<int> &mesh_indices);
+
+#endif
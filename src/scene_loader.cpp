@@ -0,0 +1,212 @@
+#include "scene_loader.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "model.hpp"
+#include "model_transform.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "scene.hpp"
+#include "structs.hpp"
+#include "transform_obj.hpp"
+
+using namespace std;
+
+SceneLoader :: SceneLoader(const Scene &scene)
+  : scene(scene), instances(scene.instances.size()), cancelled(false),
+    num_delivered(0), sources(scene.meshes.size()) {
+  for (size_t i = 0; i < instances.size(); ++i) {
+    instances[i] = i;
+  }
+}
+
+SceneLoader :: SceneLoader(const Scene &scene, const vector<size_t> &instances)
+  : scene(scene), instances(instances), cancelled(false), num_delivered(0),
+    sources(scene.meshes.size()) {
+}
+
+SceneLoader :: ~SceneLoader() {
+  cancelled = true;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void SceneLoader :: start() {
+  worker = thread(&SceneLoader::load, this);
+}
+
+void SceneLoader :: load() {
+  try {
+    vector<int> copy_nums = number_copies(scene);
+
+    // Parse each mesh the copies use before building any copy. A scene of
+    // one big mesh then parses it with every thread, where parsing it
+    // inside the copy loop would leave the threads of its other copies
+    // waiting for it with nothing to do.
+    vector<int> mesh_indices;
+    vector<bool> used(scene.meshes.size(), false);
+    for (size_t j = 0; j < instances.size(); ++j) {
+      int mesh_index = scene.instances[instances[j]].mesh_index;
+      if (!used[mesh_index]) {
+        used[mesh_index] = true;
+        mesh_indices.push_back(mesh_index);
+      }
+    }
+    parallel_for(mesh_indices.size(), [&](size_t j) {
+      int mesh_index = mesh_indices[j];
+      if (!cancelled) {
+        sources[mesh_index] = create_obj(scene.meshes[mesh_index],
+            scene.camera, scene.load_options);
+      }
+    });
+
+    // Copies go out in file order as far as the threads allow, so the
+    // first objects in the file tend to show up first
+    parallel_for(instances.size(), [&](size_t j) {
+      if (!cancelled) {
+        load_copy(instances[j], copy_nums[instances[j]]);
+      }
+    });
+  } catch (...) {
+    lock_guard<mutex> lock(results_mutex);
+    error = current_exception();
+  }
+}
+
+void SceneLoader :: load_copy(size_t i, int copy_num) {
+  const SceneInstance &instance = scene.instances[i];
+  int mesh_index = instance.mesh_index;
+
+  Model copy = transform_copy(instance, sources[mesh_index], copy_num);
+
+  LoadedObject placeholder;
+  placeholder.state = LoadedObject::BOUNDED;
+  copy.get_bounds(placeholder.min_corner, placeholder.max_corner);
+  {
+    lock_guard<mutex> lock(results_mutex);
+    bounded.push_back(make_pair(i, placeholder));
+  }
+
+  copy.set_variables();
+  {
+    lock_guard<mutex> lock(results_mutex);
+    finished.push_back(make_pair(i, move(copy)));
+  }
+}
+
+bool SceneLoader :: poll(vector<Model> &objects, vector<LoadedObject> &status) {
+  vector<pair<size_t, LoadedObject> > new_bounded;
+  vector<pair<size_t, Model> > new_finished;
+  {
+    lock_guard<mutex> lock(results_mutex);
+    if (error) {
+      rethrow_exception(error);
+    }
+    new_bounded.swap(bounded);
+    new_finished.swap(finished);
+  }
+
+  // A copy's box is always queued before its model, so boxes go first
+  for (size_t j = 0; j < new_bounded.size(); ++j) {
+    LoadedObject &current = status[new_bounded[j].first];
+    if (current.state != LoadedObject::READY) {
+      current = new_bounded[j].second;
+    }
+  }
+
+  for (size_t j = 0; j < new_finished.size(); ++j) {
+    size_t i = new_finished[j].first;
+    swap(objects[i], new_finished[j].second);
+    status[i].state = LoadedObject::READY;
+    ++num_delivered;
+  }
+
+  return !new_bounded.empty() || !new_finished.empty();
+}
+
+SceneBoundsLoader :: SceneBoundsLoader(const Scene &scene,
+    const vector<size_t> &instances)
+  : scene(scene), instances(instances), cancelled(false), num_delivered(0) {
+}
+
+SceneBoundsLoader :: ~SceneBoundsLoader() {
+  cancelled = true;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void SceneBoundsLoader :: start() {
+  worker = thread(&SceneBoundsLoader::load, this);
+}
+
+void SceneBoundsLoader :: load() {
+  // The copies of each mesh, so every file is read once
+  vector<int> mesh_indices;
+  vector<vector<size_t> > mesh_copies(scene.meshes.size());
+  for (size_t j = 0; j < instances.size(); ++j) {
+    int mesh_index = scene.instances[instances[j]].mesh_index;
+    if (mesh_copies[mesh_index].empty()) {
+      mesh_indices.push_back(mesh_index);
+    }
+    mesh_copies[mesh_index].push_back(instances[j]);
+  }
+
+  parallel_for(mesh_indices.size(), [&](size_t j) {
+    if (cancelled) {
+      return;
+    }
+    int mesh_index = mesh_indices[j];
+    Vertex min_corner, max_corner;
+    bool known;
+    try {
+      known = mesh_file_bounds(scene_mesh_path(scene.meshes[mesh_index]),
+          scene.load_options, min_corner, max_corner);
+    } catch (const char *) {
+      // Loading the copies reports the error
+      known = false;
+    }
+
+    vector<pair<size_t, LoadedObject> > boxes;
+    for (size_t k = 0; k < mesh_copies[mesh_index].size(); ++k) {
+      size_t i = mesh_copies[mesh_index][k];
+      LoadedObject box;
+      if (known) {
+        box.state = LoadedObject::BOUNDED;
+        transform_bounds(scene.instances[i], min_corner, max_corner,
+            box.min_corner, box.max_corner);
+      }
+      boxes.push_back(make_pair(i, box));
+    }
+
+    lock_guard<mutex> lock(results_mutex);
+    found.insert(found.end(), boxes.begin(), boxes.end());
+  });
+}
+
+bool SceneBoundsLoader :: poll(vector<LoadedObject> &status) {
+  vector<pair<size_t, LoadedObject> > new_found;
+  {
+    lock_guard<mutex> lock(results_mutex);
+    new_found.swap(found);
+  }
+
+  // Copies loaded (or given their exact box) meanwhile keep what they have
+  for (size_t j = 0; j < new_found.size(); ++j) {
+    LoadedObject &current = status[new_found[j].first];
+    if (current.state == LoadedObject::ESTIMATING) {
+      current = new_found[j].second;
+    }
+  }
+  num_delivered += new_found.size();
+
+  return !new_found.empty();
+}
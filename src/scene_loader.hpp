@@ -0,0 +1,128 @@
+#ifndef SCENE_LOADER_HPP
+#define SCENE_LOADER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "model.hpp"
+#include "model_transform.hpp"
+#include "scene.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+using ModelTransformPtr = shared_ptr<ModelTransform>;
+
+// What the renderer can draw for one copy while the scene loads
+struct LoadedObject {
+  enum State { PENDING, ESTIMATING, BOUNDED, READY };
+
+  // PENDING: nothing yet, ESTIMATING: not loaded and its box still being
+  // worked out by a SceneBoundsLoader (-lazy), BOUNDED: box known, READY:
+  // buffers in objects
+  State state;
+  Vertex min_corner, max_corner;
+
+  LoadedObject() : state(PENDING) {}
+};
+
+/* Builds the copies of a scene on background threads.
+ *
+ * The window can open as soon as the scene file is read: each copy is
+ * reported first with its bounding box (once its mesh is parsed and
+ * transformed) and then as a finished Model (once set_variables has built
+ * its buffers). poll hands both to the render thread, which owns objects.
+ */
+class SceneLoader {
+  public:
+    SceneLoader(const Scene &scene);
+    // Build only the copies in instances (indices into scene.instances),
+    // e.g. to rebuild the copies of a mesh that changed on disk
+    SceneLoader(const Scene &scene, const vector<size_t> &instances);
+    // Stops after the copies being built right now and waits for that
+    ~SceneLoader();
+
+    void start();
+
+    // Move everything finished since the last call into objects and status
+    // (both sized to the number of copies). True if anything changed.
+    // A copy already READY stays drawn until its replacement is finished.
+    // Rethrows on the calling thread if loading failed.
+    bool poll(vector<Model> &objects, vector<LoadedObject> &status);
+
+    // True once every copy has been handed out by poll
+    bool done() const { return num_delivered == instances.size(); }
+
+  private:
+    Scene scene;
+    // Copies to build, in the order they are started
+    vector<size_t> instances;
+    thread worker;
+    atomic<bool> cancelled;
+    size_t num_delivered;
+
+    // Results waiting for the next poll, guarded by results_mutex
+    mutex results_mutex;
+    vector<pair<size_t, LoadedObject> > bounded;
+    vector<pair<size_t, Model> > finished;
+    exception_ptr error;
+
+    // Source objects, parsed by load before any copy is built
+    vector<ModelTransformPtr> sources;
+
+    void load();
+    void load_copy(size_t i, int copy_num);
+
+    SceneLoader(const SceneLoader &);
+    SceneLoader &operator=(const SceneLoader &);
+};
+
+/* Works out the boxes of copies that are not loaded (-lazy) on a
+ * background thread.
+ *
+ * Each mesh file the copies use gives its box without being loaded (see
+ * mesh_file_bounds), which is then moved by the transforms of each copy.
+ * That can still mean a pass over a whole .obj, so it stays off the render
+ * thread like SceneLoader.
+ */
+class SceneBoundsLoader {
+  public:
+    SceneBoundsLoader(const Scene &scene, const vector<size_t> &instances);
+    // Stops after the meshes being read right now and waits for that
+    ~SceneBoundsLoader();
+
+    void start();
+
+    // Hand the boxes found since the last call to the copies in status that
+    // are still ESTIMATING: BOUNDED with the box, or PENDING if the mesh
+    // file gives none without loading it. True if anything changed.
+    bool poll(vector<LoadedObject> &status);
+
+    // True once every copy has been handed out by poll
+    bool done() const { return num_delivered == instances.size(); }
+
+  private:
+    Scene scene;
+    vector<size_t> instances;
+    thread worker;
+    atomic<bool> cancelled;
+    size_t num_delivered;
+
+    // Boxes waiting for the next poll, guarded by results_mutex
+    mutex results_mutex;
+    vector<pair<size_t, LoadedObject> > found;
+
+    void load();
+
+    SceneBoundsLoader(const SceneBoundsLoader &);
+    SceneBoundsLoader &operator=(const SceneBoundsLoader &);
+};
+
+#endif
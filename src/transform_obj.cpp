@@ -1,5 +1,6 @@
 #include "transform_obj.hpp"
 
+#include <algorithm>
 #include <fstream> // basic file operations
 #include <iostream>
 #include <map>
@@ -9,7 +10,9 @@
 #include "geometric_transform.hpp"
 #include "model.hpp"
 #include "model_transform.hpp"
+#include "parallel.hpp"
 #include "parser.hpp"
+#include "scene.hpp"
 #include "structs.hpp"
 
 using namespace std;
@@ -19,61 +22,83 @@ using ModelTransformPtr = shared_ptr<ModelTransform>;
 using MatrixPtr = shared_ptr<Eigen::MatrixXd>;
 
 vector<Model> parse_obj_data(char *file_name) {
-  return store_obj_transform_file(file_name);
+  return store_obj_transform_file(load_scene(file_name));
 }
 
-vector<Model> store_obj_transform_file(char *file_name) {
-  ifstream obj_transform_file(file_name);
-  CameraPtr cam = get_camera_data(obj_transform_file);
-  // Parse light data to move ifstream along but discard
-  get_light_data(obj_transform_file);
+vector<Model> store_obj_transform_file(const Scene &scene) {
   // Parse .obj files
-  shared_ptr<map<string, ModelTransformPtr>> models =
-    get_objects(obj_transform_file, cam);
+  shared_ptr<map<string, ModelTransformPtr>> models = get_objects(scene);
   // Create copies and perform geometric transformations
-  vector<Model> transformed = perform_transforms(obj_transform_file, models);
+  vector<Model> transformed = perform_transforms(scene, models);
 
   return transformed;
 }
 
-// filename lines have been removed from the ifstream
-vector<Model> perform_transforms(ifstream& obj_transform_file, shared_ptr<map<string, ModelTransformPtr>> models) {
-  vector<Model> trans_models = vector<Model>();
+vector<int> number_copies(const Scene &scene) {
+  vector<int> copy_nums(scene.instances.size());
+  vector<int> made(scene.meshes.size(), 0);
+  for (size_t i = 0; i < scene.instances.size(); ++i) {
+    copy_nums[i] = ++made[scene.instances[i].mesh_index];
+  }
+  return copy_nums;
+}
 
-  vector<string> lines;
+vector<Model> perform_transforms(const Scene &scene, shared_ptr<map<string, ModelTransformPtr>> models) {
+  size_t num_instances = scene.instances.size();
 
-  string line;
-  while (getline(obj_transform_file, line)) {
-    if (line == "") {
-      // Perform geo transforms to world coord. and store material properties
-      trans_models.push_back(perform_transform(lines, models));
-      lines.erase(lines.begin(), lines.end());
-    } else {
-      lines.push_back(line);
-    }
+  // Number the copies of each object in file order up front so names do
+  // not depend on which thread finishes first
+  vector<int> copy_nums = number_copies(scene);
+  for (size_t i = 0; i < num_instances; ++i) {
+    models->at(scene.instances[i].mesh_name)->copy_num = copy_nums[i];
   }
 
-  if (!lines.empty()) {
-    trans_models.push_back(perform_transform(lines, models));
-  }
+  // Every copy is independent, each thread fills its own slot
+  vector<Model> trans_models(num_instances);
+  parallel_for(num_instances, [&](size_t i) {
+    // Perform geo transforms to world coord. and store material properties
+    trans_models[i] = perform_transform(scene.instances[i], models, copy_nums[i]);
+  });
 
   return trans_models;
 }
 
-Model perform_transform(vector<string> lines, shared_ptr<map<string, ModelTransformPtr>> models) {
-  // Remove name from vector of lines
-  string name = lines.front();
-  lines.erase(lines.begin());
-
-  MaterialPtr material = store_material_properties(lines);
-  lines.erase(lines.begin(), lines.begin() + 4);
+Model perform_transform(const SceneInstance &instance, shared_ptr<map<string, ModelTransformPtr>> models, int copy_num) {
+  Model new_copy = transform_copy(instance, models->at(instance.mesh_name), copy_num);
+  new_copy.set_variables();
+  return new_copy;
+}
 
-  MatrixPtr trans_mat = multiply_matrices(lines);
-  MatrixPtr norm_trans_mat = create_norm_trans_mat(lines);
+Model transform_copy(const SceneInstance &instance, ModelTransformPtr source, int copy_num) {
+  MatrixPtr trans_mat = multiply_matrices(instance.transform_lines);
+  MatrixPtr norm_trans_mat = create_norm_trans_mat(instance.transform_lines);
 
   // Apply geometric transforms to vertices and normals
-  Model new_copy = (*models)[name]->apply_trans_mat(trans_mat, norm_trans_mat);
-  new_copy.material = material;
-  new_copy.set_variables();
+  Model new_copy = source->apply_trans_mat(trans_mat, norm_trans_mat, copy_num);
+  new_copy.material = instance.material;
   return new_copy;
 }
+
+void transform_bounds(const SceneInstance &instance, const Vertex &min_corner,
+    const Vertex &max_corner, Vertex &copy_min, Vertex &copy_max) {
+  Eigen::Matrix4d trans_mat(*multiply_matrices(instance.transform_lines));
+
+  // The box of the eight transformed corners holds the transformed box
+  for (int corner = 0; corner < 8; ++corner) {
+    Vertex moved = transform_vertex(trans_mat, Vertex(
+          (corner & 1) ? max_corner.x : min_corner.x,
+          (corner & 2) ? max_corner.y : min_corner.y,
+          (corner & 4) ? max_corner.z : min_corner.z));
+    if (corner == 0) {
+      copy_min = moved;
+      copy_max = moved;
+      continue;
+    }
+    copy_min.x = min(copy_min.x, moved.x);
+    copy_min.y = min(copy_min.y, moved.y);
+    copy_min.z = min(copy_min.z, moved.z);
+    copy_max.x = max(copy_max.x, moved.x);
+    copy_max.y = max(copy_max.y, moved.y);
+    copy_max.z = max(copy_max.z, moved.z);
+  }
+}
@@ -10,18 +10,31 @@
 #include "camera.hpp"
 #include "model.hpp"
 #include "model_transform.hpp"
+#include "scene.hpp"
 #include "structs.hpp"
 
 using namespace std;
 
 using ModelTransformPtr = shared_ptr<ModelTransform>;
 
-// store original objects from .obj files
-vector<Model> store_obj_transform_file(char *file_name);
+// store original objects from the scene's .obj files and make its copies
+vector<Model> store_obj_transform_file(const Scene &scene);
 
-// transforms helper function for all transforms
-vector<Model> perform_transforms(ifstream& obj_transform_file, shared_ptr<map<string, ModelTransformPtr>> models);
-// transforms helper function for one copy
-Model perform_transform(vector<string> lines, shared_ptr<map<string, ModelTransformPtr>> models);
+// transforms helper function for all transforms, copies are built in
+// parallel but returned in scene file order
+vector<Model> perform_transforms(const Scene &scene, shared_ptr<map<string, ModelTransformPtr>> models);
+// transforms helper function for one copy, copy_num is used in its name
+Model perform_transform(const SceneInstance &instance, shared_ptr<map<string, ModelTransformPtr>> models, int copy_num);
+// geo-transformed copy of source with the instance's material but without
+// render buffers (set_variables has not been called)
+Model transform_copy(const SceneInstance &instance, ModelTransformPtr source, int copy_num);
+
+// copy number of every instance, counting per object in file order
+vector<int> number_copies(const Scene &scene);
+
+// box around the instance's copy of a mesh whose own box is min_corner to
+// max_corner, known without parsing the mesh
+void transform_bounds(const SceneInstance &instance, const Vertex &min_corner,
+    const Vertex &max_corner, Vertex &copy_min, Vertex &copy_max);
 
 #endif
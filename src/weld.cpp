@@ -0,0 +1,191 @@
+#include "weld.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "model.hpp"
+#include "parallel.hpp"
+#include "structs.hpp"
+
+using namespace std;
+
+// Vertices handed to each parallel_for item
+static const size_t WELD_CHUNK = 1 << 14;
+
+/* With epsilon > 0 the cells are 2 epsilon wide, so the box of half width
+ * epsilon around a vertex touches at most 2 cells along each axis and at
+ * most 8 in all. With epsilon 0 only identical vertices match and the float
+ * bits themselves are the cell.
+ */
+static int64_t cell_coordinate(float value, double cell_size) {
+  if (cell_size > 0) {
+    double cell = floor(value / cell_size);
+    // Far away cells only need to stay distinct from the nearby ones
+    const double limit = 4e18;
+    return int64_t(max(-limit, min(cell, limit)));
+  }
+
+  uint32_t bits = 0;
+  if (value != 0) {
+    // -0 and 0 are the same position
+    memcpy(&bits, &value, sizeof(bits));
+  }
+  return bits;
+}
+
+// Cells along one axis that can hold a vertex within epsilon of value
+static void cell_range(float value, float epsilon, double cell_size,
+    int64_t &first, int64_t &last) {
+  if (cell_size > 0) {
+    first = cell_coordinate(value - epsilon, cell_size);
+    last = cell_coordinate(value + epsilon, cell_size);
+  } else {
+    first = last = cell_coordinate(value, cell_size);
+  }
+}
+
+static uint64_t cell_hash(int64_t x, int64_t y, int64_t z) {
+  uint64_t h = uint64_t(x) * 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 31)) + uint64_t(y) * 0xc2b2ae3d27d4eb4fULL;
+  h = (h ^ (h >> 29)) + uint64_t(z) * 0x165667b19e3779f9ULL;
+  h ^= h >> 32;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  return h ^ (h >> 29);
+}
+
+static bool valid_index(int index, size_t num_vertices) {
+  return index >= 1 && size_t(index) <= num_vertices;
+}
+
+WeldStats weld_vertices(Model &model, float epsilon) {
+  WeldStats stats = {0, 0};
+  if (model.vertices.size() <= 2) {
+    return stats;
+  }
+
+  // Work on 0-based indices, vertex 0 of the model is a filler
+  const Vertex *vertices = model.vertices.data() + 1;
+  size_t num_vertices = model.vertices.size() - 1;
+  double epsilon_squared = double(epsilon) * epsilon;
+  double cell_size = 2.0 * epsilon;
+
+  size_t num_buckets = 1;
+  while (num_buckets < num_vertices) {
+    num_buckets <<= 1;
+  }
+  const uint64_t mask = num_buckets - 1;
+
+  // Bucket every vertex by the hash of its cell
+  vector<uint32_t> bucket_of(num_vertices);
+  parallel_chunks(num_vertices, WELD_CHUNK, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      const Vertex &v = vertices[i];
+      bucket_of[i] = cell_hash(cell_coordinate(v.x, cell_size),
+          cell_coordinate(v.y, cell_size),
+          cell_coordinate(v.z, cell_size)) & mask;
+    }
+  });
+
+  // Counting sort, so each bucket lists its vertices in increasing order
+  vector<uint32_t> bucket_start(num_buckets + 1, 0);
+  for (size_t i = 0; i < num_vertices; ++i) {
+    ++bucket_start[bucket_of[i] + 1];
+  }
+  for (size_t b = 0; b < num_buckets; ++b) {
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  vector<uint32_t> bucket_vertices(num_vertices);
+  {
+    vector<uint32_t> next(bucket_start.begin(), bucket_start.end() - 1);
+    for (size_t i = 0; i < num_vertices; ++i) {
+      bucket_vertices[next[bucket_of[i]]++] = i;
+    }
+  }
+  vector<uint32_t>().swap(bucket_of);
+
+  // For each vertex, the first earlier vertex within epsilon (or itself)
+  vector<uint32_t> earlier(num_vertices);
+  parallel_chunks(num_vertices, WELD_CHUNK, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      const Vertex &v = vertices[i];
+      uint32_t match = i;
+
+      int64_t x0, x1, y0, y1, z0, z1;
+      cell_range(v.x, epsilon, cell_size, x0, x1);
+      cell_range(v.y, epsilon, cell_size, y0, y1);
+      cell_range(v.z, epsilon, cell_size, z0, z1);
+
+      for (int64_t x = x0; x <= x1; ++x) {
+        for (int64_t y = y0; y <= y1; ++y) {
+          for (int64_t z = z0; z <= z1; ++z) {
+            uint64_t b = cell_hash(x, y, z) & mask;
+            for (uint32_t k = bucket_start[b]; k < bucket_start[b + 1]; ++k) {
+              uint32_t j = bucket_vertices[k];
+              if (j >= match) {
+                break;
+              }
+              double ex = double(vertices[j].x) - v.x;
+              double ey = double(vertices[j].y) - v.y;
+              double ez = double(vertices[j].z) - v.z;
+              if (ex * ex + ey * ey + ez * ez <= epsilon_squared) {
+                match = j;
+                break;
+              }
+            }
+          }
+        }
+      }
+      earlier[i] = match;
+    }
+  });
+
+  // Follow chains to the first vertex of each group (earlier ones are
+  // already resolved) and number the survivors, 1-based for the model
+  vector<int> new_index(num_vertices);
+  int next_index = 1;
+  for (size_t i = 0; i < num_vertices; ++i) {
+    if (earlier[i] == i) {
+      new_index[i] = next_index++;
+    } else {
+      new_index[i] = new_index[earlier[i]];
+    }
+  }
+  stats.merged_vertices = num_vertices - (next_index - 1);
+  if (stats.merged_vertices == 0) {
+    return stats;
+  }
+
+  // Survivors move down in place, their order is unchanged
+  for (size_t i = 0; i < num_vertices; ++i) {
+    if (earlier[i] == i) {
+      model.vertices[new_index[i]] = model.vertices[i + 1];
+    }
+  }
+  model.vertices.resize(next_index);
+
+  vector<Face> &faces = model.faces;
+  parallel_chunks(faces.size(), WELD_CHUNK, [&](size_t first, size_t last) {
+    for (size_t f = first; f < last; ++f) {
+      if (!valid_index(faces[f].vertex1, num_vertices)
+          || !valid_index(faces[f].vertex2, num_vertices)
+          || !valid_index(faces[f].vertex3, num_vertices)) {
+        throw "Face refers to a missing vertex";
+      }
+      faces[f].vertex1 = new_index[faces[f].vertex1 - 1];
+      faces[f].vertex2 = new_index[faces[f].vertex2 - 1];
+      faces[f].vertex3 = new_index[faces[f].vertex3 - 1];
+    }
+  });
+
+  size_t num_faces = faces.size();
+  faces.erase(remove_if(faces.begin(), faces.end(), [](const Face &face) {
+    return face.vertex1 == face.vertex2 || face.vertex2 == face.vertex3
+      || face.vertex1 == face.vertex3;
+  }), faces.end());
+  stats.dropped_faces = num_faces - faces.size();
+
+  return stats;
+}
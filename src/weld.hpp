@@ -0,0 +1,30 @@
+#ifndef WELD_HPP
+#define WELD_HPP
+
+#include <cstddef>
+
+#include "model.hpp"
+
+using namespace std;
+
+/* Merging duplicate vertices.
+ *
+ * Exports that write every face with its own copy of its corners leave
+ * build_HE with disconnected triangles. weld_vertices finds vertices within
+ * epsilon of each other with a hash grid of 2 epsilon sized cells (at most
+ * the 8 cells around a vertex can hold a match), keeps the first of each
+ * group and remaps the faces. Cell lookups run on all worker threads; the
+ * whole pass is linear in the number of vertices.
+ */
+
+struct WeldStats {
+  size_t merged_vertices;
+  // Faces left with a repeated corner after merging
+  size_t dropped_faces;
+};
+
+// Merge vertices of model within epsilon (0 merges exact duplicates only)
+// and drop the faces that collapse. Surviving vertices keep their order.
+WeldStats weld_vertices(Model &model, float epsilon);
+
+#endif
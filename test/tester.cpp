@@ -1,21 +1,1466 @@
 #define BOOST_TEST_MODULE Tests
 #include <boost/test/included/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib> // setenv, unsetenv, mkstemps
+#include <cstring>
+#include <map>
 #include <memory> // shared_ptr
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h> // AT_FDCWD
+#include <sys/stat.h> // utimensat
+#include <unistd.h>
+#include <zlib.h>
+
+#include "compact_mesh.hpp"
+#include "geometric_transform.hpp"
+#include "halfedge.hpp"
+#include "implicit_fairing.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_writer.hpp"
+#include "model.hpp"
+#include "obj_parser.hpp"
+#include "parser.hpp"
+#include "ply_parser.hpp"
+#include "reorder.hpp"
+#include "scene.hpp"
+#include "structs.hpp"
+#include "transform_obj.hpp"
+#include "weld.hpp"
+
+#include "Eigen/Dense"
+#include "Eigen/Sparse"
+
+using namespace std;
 
 // #include "parser.hpp"
 
+// An open n by n grid of vertices on a bumpy height field, each square
+// split into two triangles along alternating diagonals (so corner vertices
+// have one or two faces and the rest up to six)
+static Model make_grid(int n) {
+  // (Model starts with the filler vertex)
+  Model model;
+  for (int row = 0; row < n; ++row) {
+    for (int col = 0; col < n; ++col) {
+      // Uneven spacing and heights, so the cot weights and normals differ
+      model.vertices.push_back(Vertex(col + 0.1 * row * col, row,
+            0.2 * ((row * col + col) % 3)));
+    }
+  }
+  for (int row = 0; row + 1 < n; ++row) {
+    for (int col = 0; col + 1 < n; ++col) {
+      int a = row * n + col + 1;
+      int b = a + 1;
+      int c = a + n;
+      int d = c + 1;
+      if ((row + col) % 2 == 0) {
+        model.faces.push_back(Face(a, b, d));
+        model.faces.push_back(Face(a, d, c));
+      } else {
+        model.faces.push_back(Face(a, b, c));
+        model.faces.push_back(Face(b, d, c));
+      }
+    }
+  }
+  // set_variables copies the colors
+  ReflectPtr grey(new Reflectance(0.5, 0.5, 0.5));
+  model.material->ambient = grey;
+  model.material->diffuse = grey;
+  model.material->specular = grey;
+  model.material->shininess = 1;
+  return model;
+}
+
+// The faces of an n by n torus: the grid of make_grid with its last row
+// and column joined back to the first, so it is closed. Vertices are 1 to
+// n * n.
+static vector<Face> torus_faces(int n) {
+  vector<Face> faces;
+  for (int row = 0; row < n; ++row) {
+    for (int col = 0; col < n; ++col) {
+      int a = row * n + col + 1;
+      int b = row * n + (col + 1) % n + 1;
+      int c = (row + 1) % n * n + col + 1;
+      int d = (row + 1) % n * n + (col + 1) % n + 1;
+      faces.push_back(Face(a, b, d));
+      faces.push_back(Face(a, d, c));
+    }
+  }
+  return faces;
+}
+
+static vector<Face> octahedron_faces() {
+  // 1 and 6 are the poles, 2 to 5 go around the middle
+  vector<Face> faces;
+  for (int k = 0; k < 4; ++k) {
+    int a = 2 + k;
+    int b = 2 + (k + 1) % 4;
+    faces.push_back(Face(1, a, b));
+    faces.push_back(Face(6, b, a));
+  }
+  return faces;
+}
+
+// Reverse every step'th face, starting at start
+static void reverse_faces(vector<Face> &faces, size_t start, size_t step) {
+  for (size_t f = start; f < faces.size(); f += step) {
+    swap(faces[f].vertex2, faces[f].vertex3);
+  }
+}
+
+// Every flip goes the other way along its edge and back, every out leaves
+// its vertex, every face keeps its corners (in some winding), and the
+// components hold every face once. Returns the number of boundary
+// halfedges.
+static size_t check_halfedges(const HalfedgeMesh &mesh,
+    const vector<Face> &faces, size_t num_vertices) {
+  BOOST_REQUIRE_EQUAL(mesh.num_faces(), faces.size());
+  BOOST_REQUIRE_EQUAL(mesh.num_vertices(), num_vertices);
+
+  size_t boundary = 0;
+  for (uint32_t he = 0; he < mesh.edges.size(); ++he) {
+    uint32_t flip = mesh.edges[he].flip;
+    if (flip == NO_HALFEDGE) {
+      ++boundary;
+      continue;
+    }
+    BOOST_CHECK_EQUAL(mesh.edges[flip].flip, he);
+    BOOST_CHECK_EQUAL(mesh.edges[flip].vertex,
+        mesh.edges[HalfedgeMesh::next(he)].vertex);
+    BOOST_CHECK_EQUAL(mesh.edges[HalfedgeMesh::next(flip)].vertex,
+        mesh.edges[he].vertex);
+  }
+
+  for (size_t f = 0; f < faces.size(); ++f) {
+    int expected[3] = {faces[f].vertex1, faces[f].vertex2, faces[f].vertex3};
+    int found[3];
+    for (int k = 0; k < 3; ++k) {
+      found[k] = mesh.edges[HalfedgeMesh::face_edge(f) + k].vertex;
+    }
+    sort(expected, expected + 3);
+    sort(found, found + 3);
+    BOOST_CHECK(equal(expected, expected + 3, found));
+  }
+
+  vector<bool> used(num_vertices, false);
+  for (size_t f = 0; f < faces.size(); ++f) {
+    used[faces[f].vertex1] = used[faces[f].vertex2] =
+      used[faces[f].vertex3] = true;
+  }
+  for (uint32_t v = 0; v < num_vertices; ++v) {
+    if (!used[v]) {
+      BOOST_CHECK_EQUAL(mesh.out[v], NO_HALFEDGE);
+    } else {
+      BOOST_REQUIRE(mesh.out[v] < mesh.edges.size());
+      BOOST_CHECK_EQUAL(mesh.edges[mesh.out[v]].vertex, v);
+    }
+  }
+
+  BOOST_REQUIRE(!mesh.component_start.empty());
+  BOOST_CHECK_EQUAL(mesh.component_start.back(), faces.size());
+  vector<uint32_t> sorted_faces(mesh.component_faces);
+  sort(sorted_faces.begin(), sorted_faces.end());
+  for (size_t f = 0; f < sorted_faces.size(); ++f) {
+    BOOST_CHECK_EQUAL(sorted_faces[f], f);
+  }
+  return boundary;
+}
+
+// Halfedges every walk around v meets, from out with next_around
+static size_t count_around(const HalfedgeMesh &mesh, uint32_t v) {
+  size_t count = 0;
+  uint32_t he = mesh.out[v];
+  do {
+    ++count;
+    he = mesh.next_around(he);
+  } while (he != NO_HALFEDGE && he != mesh.out[v]);
+  return count;
+}
+
+// build_HE with NUM_THREADS set to threads
+static bool build_HE_with(const vector<Face> &faces, size_t num_vertices,
+    const char *threads, HalfedgeMesh &mesh) {
+  setenv("NUM_THREADS", threads, 1);
+  bool consistent = build_HE(faces, num_vertices, mesh);
+  unsetenv("NUM_THREADS");
+  return consistent;
+}
+
+// A new empty file /tmp/tester_XXXXXX<suffix>, for the caller to remove
+static string temp_file(const string &suffix) {
+  string pattern = "/tmp/tester_XXXXXX" + suffix;
+  vector<char> name(pattern.begin(), pattern.end());
+  name.push_back('\0');
+  int fd = mkstemps(name.data(), suffix.size());
+  BOOST_REQUIRE(fd >= 0);
+  close(fd);
+  return string(name.data());
+}
+
+static void write_file(const string &file_name, const string &contents) {
+  FILE *out = fopen(file_name.c_str(), "wb");
+  BOOST_REQUIRE(out != NULL);
+  BOOST_REQUIRE_EQUAL(fwrite(contents.data(), 1, contents.size(), out),
+      contents.size());
+  fclose(out);
+}
+
+static void write_gzip_file(const string &file_name, const string &contents) {
+  gzFile out = gzopen(file_name.c_str(), "wb");
+  BOOST_REQUIRE(out != NULL);
+  BOOST_REQUIRE_EQUAL(gzwrite(out, contents.data(), contents.size()),
+      (int) contents.size());
+  gzclose(out);
+}
+
+// model as .obj text, every float written so it reads back the same
+static string obj_text(const Model &model) {
+  ostringstream text;
+  char line[128];
+  for (size_t v = 1; v < model.vertices.size(); ++v) {
+    snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", model.vertices[v].x,
+        model.vertices[v].y, model.vertices[v].z);
+    text << line;
+  }
+  for (size_t f = 0; f < model.faces.size(); ++f) {
+    text << "f " << model.faces[f].vertex1 << " " << model.faces[f].vertex2
+      << " " << model.faces[f].vertex3 << "\n";
+  }
+  return text.str();
+}
+
+static void check_same_mesh(const Model &found, const Model &expected) {
+  BOOST_REQUIRE_EQUAL(found.vertices.size(), expected.vertices.size());
+  BOOST_REQUIRE_EQUAL(found.faces.size(), expected.faces.size());
+  for (size_t v = 1; v < found.vertices.size(); ++v) {
+    BOOST_CHECK_EQUAL(found.vertices[v].x, expected.vertices[v].x);
+    BOOST_CHECK_EQUAL(found.vertices[v].y, expected.vertices[v].y);
+    BOOST_CHECK_EQUAL(found.vertices[v].z, expected.vertices[v].z);
+  }
+  for (size_t f = 0; f < found.faces.size(); ++f) {
+    BOOST_CHECK_EQUAL(found.faces[f].vertex1, expected.faces[f].vertex1);
+    BOOST_CHECK_EQUAL(found.faces[f].vertex2, expected.faces[f].vertex2);
+    BOOST_CHECK_EQUAL(found.faces[f].vertex3, expected.faces[f].vertex3);
+  }
+}
+
+static Eigen::Vector3d position(const Model &model, int v) {
+  const Vertex &vertex = model.vertices[v];
+  return Eigen::Vector3d(vertex.x, vertex.y, vertex.z);
+}
+
+// F as build_F_operator should give it, summed face by face: every face
+// adds the cot of each corner to the weight of the opposite edge and its
+// area to its three vertices
+static map<pair<int, int>, double> reference_F(const Model &model,
+    double time_step) {
+  size_t num_vertices = model.vertices.size();
+  vector<double> area(num_vertices, 0);
+  map<pair<int, int>, double> weight;
+
+  for (size_t f = 0; f < model.faces.size(); ++f) {
+    int corners[3] = {model.faces[f].vertex1, model.faces[f].vertex2,
+      model.faces[f].vertex3};
+    Eigen::Vector3d p[3];
+    for (int k = 0; k < 3; ++k) {
+      p[k] = position(model, corners[k]);
+    }
+    double face_area = (p[1] - p[0]).cross(p[2] - p[0]).norm();
+    for (int k = 0; k < 3; ++k) {
+      area[corners[k]] += face_area;
+      Eigen::Vector3d u = p[(k + 1) % 3] - p[k];
+      Eigen::Vector3d w = p[(k + 2) % 3] - p[k];
+      double cot = u.dot(w) / u.cross(w).norm();
+      int i = corners[(k + 1) % 3];
+      int j = corners[(k + 2) % 3];
+      weight[make_pair(i, j)] += cot;
+      weight[make_pair(j, i)] += cot;
+    }
+  }
+
+  map<pair<int, int>, double> F;
+  for (size_t i = 1; i < num_vertices; ++i) {
+    F[make_pair(i, i)] = 1;
+  }
+  map<pair<int, int>, double>::const_iterator it;
+  for (it = weight.begin(); it != weight.end(); ++it) {
+    int i = it->first.first;
+    double scale = time_step / 2.0 / area[i];
+    F[it->first] = -scale * it->second;
+    F[make_pair(i, i)] += scale * it->second;
+  }
+  return F;
+}
+
 BOOST_AUTO_TEST_CASE(simple_test) {
   BOOST_CHECK_EQUAL(2+2, 4);
 }
 
+// scan_float has to read what strtof reads, to the same bits
+static void check_scan_float(const string &text) {
+  const char *begin = text.c_str();
+  char *strtof_end;
+  float expected = strtof(begin, &strtof_end);
+
+  const char *p = begin;
+  float value;
+  bool found = scan_float(p, begin + text.size(), value);
+  BOOST_CHECK_MESSAGE(found == (strtof_end != begin), "\"" << text << "\"");
+  if (!found) {
+    return;
+  }
+  BOOST_CHECK_MESSAGE(p == strtof_end, "\"" << text << "\" read "
+      << p - begin << " characters, strtof " << strtof_end - begin);
+  if (isnan(expected)) {
+    BOOST_CHECK_MESSAGE(isnan(value), "\"" << text << "\"");
+  } else {
+    BOOST_CHECK_MESSAGE(memcmp(&value, &expected, sizeof(float)) == 0,
+        "\"" << text << "\" gave " << value << ", strtof " << expected);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(scan_float_test) {
+  const char *cases[] = {
+    "0", "-0", "1", "-1", "+2.5", ".5", "5.", "-.5", "+.25e1", "0.1",
+    "1e10", "1E-10", "1e+5", "2.5e-3", "-7.0E+2", "1e", "1e+", "3e-x",
+    // Largest float, then overflow to inf
+    "3.4028234663852886e38", "3.4028235e38", "3.5e38", "-1e39", "1e400",
+    // Smallest normal and denormals down to underflow
+    "1.17549435e-38", "1e-39", "1.4e-45", "1e-45", "7e-46", "1e-50",
+    // More digits than a uint64 holds, or than matter
+    "3.14159265358979323846264338327950288",
+    "123456789012345678901234567890",
+    "0.000000000000000000000000000001234",
+    "0.30000000000000000000000000000000000001",
+    // Halfway between two floats, and just either side
+    "16777217", "16777217.000000001", "16777216.999999999",
+    "1.00000005960464477539062500", "1.000000059604644775390625001",
+    "nan", "inf", "-inf", "-", ".", "e5", "x",
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    check_scan_float(cases[i]);
+  }
+
+  // Random floats written the ways exporters write them
+  srand(1);
+  const char *formats[] = {"%.9g", "%.17g", "%.6f", "%.3e", "%.12e"};
+  for (int i = 0; i < 20000; ++i) {
+    uint32_t bits = (uint32_t(rand()) << 16) ^ uint32_t(rand());
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    if (isnan(x) || isinf(x)) {
+      continue;
+    }
+    char text[64];
+    snprintf(text, sizeof(text), formats[i % 5], x);
+    check_scan_float(text);
+  }
+}
+
+// The vectorized scan has to agree with memchr wherever the newline is,
+// including before, on and after 16 byte block edges
+BOOST_AUTO_TEST_CASE(find_line_end_test) {
+  for (size_t length = 0; length < 70; ++length) {
+    string text(length, 'x');
+    BOOST_CHECK(find_line_end(text.data(), text.data() + length)
+        == text.data() + length);
+    for (size_t newline = 0; newline < length; ++newline) {
+      string line = text;
+      line[newline] = '\n';
+      if (newline + 3 < length) {
+        line[newline + 3] = '\n';
+      }
+      for (size_t start = 0; start <= newline; start += 5) {
+        const char *begin = line.data() + start;
+        const char *end = line.data() + length;
+        const char *expected =
+          static_cast<const char *>(memchr(begin, '\n', end - begin));
+        BOOST_CHECK(find_line_end(begin, end) == expected);
+      }
+    }
+  }
+}
+
+static void parse_obj_text(const string &text, vector<Vertex> &vertices,
+    vector<Face> &faces, size_t num_chunks = 0) {
+  const char *begin = text.data();
+  if (num_chunks == 0) {
+    parse_obj_lines(begin, begin + text.size(), vertices, faces);
+  } else {
+    parse_obj_lines_parallel(begin, begin + text.size(), vertices, faces,
+        num_chunks);
+  }
+}
+
+// Corners with texture and normal indices, relative indices, polygons,
+// CRLF line ends and statements the Model does not keep, all in one file
+static const char MIXED_OBJ[] =
+  "# comment\r\n"
+  "v 0 0 0\r\n"
+  "v 1 0 0\n"
+  "vt 0 0\n"
+  "vn 0 0 1\n"
+  "v 1 1 0 1.0\n"
+  "v 0 1 0\n"
+  "\n"
+  "o thing\n"
+  "g group\n"
+  "s off\n"
+  "usemtl m\n"
+  "f 1 2 3\n"
+  "f 1/1 3/1 4/1\r\n"
+  "f 1//1 2//1 -1//1\n"
+  "f -4/1/1 -3/1/1 -2/1/1 -1/1/1\r\n"
+  "v 2 0 0\n"
+  "v 2 1 0\n"
+  "f -2 -1 3 2 1\n"
+  "  f\t5 6 -3  \r\n"
+  "l 1 2\n"
+  "f -6 -5 -4";
+
+BOOST_AUTO_TEST_CASE(parse_obj_line_test) {
+  vector<Vertex> vertices;
+  vector<Face> faces;
+  parse_obj_text(MIXED_OBJ, vertices, faces);
+
+  BOOST_REQUIRE_EQUAL(vertices.size(), 6u);
+  BOOST_CHECK_EQUAL(vertices[2].x, 1);
+  BOOST_CHECK_EQUAL(vertices[2].y, 1);
+  BOOST_CHECK_EQUAL(vertices[5].x, 2);
+
+  const int expected[][3] = {
+    {1, 2, 3}, {1, 3, 4}, {1, 2, 4},
+    // Quad split into a fan around its first corner
+    {1, 2, 3}, {1, 3, 4},
+    {5, 6, 3}, {5, 3, 2}, {5, 2, 1},
+    {5, 6, 4}, {1, 2, 3},
+  };
+  size_t num_expected = sizeof(expected) / sizeof(expected[0]);
+  BOOST_REQUIRE_EQUAL(faces.size(), num_expected);
+  for (size_t f = 0; f < num_expected; ++f) {
+    BOOST_CHECK_EQUAL(faces[f].vertex1, expected[f][0]);
+    BOOST_CHECK_EQUAL(faces[f].vertex2, expected[f][1]);
+    BOOST_CHECK_EQUAL(faces[f].vertex3, expected[f][2]);
+  }
+
+  const char *bad[] = {
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n",
+    "v 0 0 0\nf -1 -2 -3\n",
+    "f -1 -2 -3\nv 0 0 0\nv 1 0 0\nv 0 1 0\n",
+    "v 0 0 0\nv 1 0 0\nf 1 2\n",
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2x 3\n",
+    "v 1 2\n",
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    vector<Vertex> bad_vertices;
+    vector<Face> bad_faces;
+    BOOST_CHECK_THROW(parse_obj_text(bad[i], bad_vertices, bad_faces),
+        const char *);
+  }
+  // Split so the relative face and the vertices before it land in
+  // different chunks
+  for (size_t chunks = 1; chunks <= 4; ++chunks) {
+    vector<Vertex> bad_vertices;
+    vector<Face> bad_faces;
+    BOOST_CHECK_THROW(parse_obj_text(bad[1], bad_vertices, bad_faces, chunks),
+        const char *);
+  }
+}
+
+// However the file is cut into chunks, relative indices (which then count
+// back into earlier chunks) come out as in one serial pass
+BOOST_AUTO_TEST_CASE(parse_obj_lines_parallel_test) {
+  // The mixed file a few times over, so the cuts fall everywhere
+  string text;
+  for (int k = 0; k < 4; ++k) {
+    text += MIXED_OBJ;
+    text += "\n";
+  }
+  vector<Vertex> serial_vertices;
+  vector<Face> serial_faces;
+  parse_obj_text(text, serial_vertices, serial_faces);
+
+  for (size_t chunks = 1; chunks <= 64; ++chunks) {
+    vector<Vertex> vertices;
+    vector<Face> faces;
+    parse_obj_text(text, vertices, faces, chunks);
+    BOOST_REQUIRE_EQUAL(vertices.size(), serial_vertices.size());
+    BOOST_REQUIRE_EQUAL(faces.size(), serial_faces.size());
+    for (size_t v = 0; v < vertices.size(); ++v) {
+      BOOST_CHECK_EQUAL(vertices[v].x, serial_vertices[v].x);
+      BOOST_CHECK_EQUAL(vertices[v].y, serial_vertices[v].y);
+      BOOST_CHECK_EQUAL(vertices[v].z, serial_vertices[v].z);
+    }
+    for (size_t f = 0; f < faces.size(); ++f) {
+      BOOST_CHECK_EQUAL(faces[f].vertex1, serial_faces[f].vertex1);
+      BOOST_CHECK_EQUAL(faces[f].vertex2, serial_faces[f].vertex2);
+      BOOST_CHECK_EQUAL(faces[f].vertex3, serial_faces[f].vertex3);
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE(parse_obj_file_test) {
-  // string test_file = "../data/cube.obj".c_str();
-  // ThreeDModelPtr model = parse_file_to_model(test_file.c_str());
-  // VertexPtr ver = model->vertices->front();
-  // BOOST_CHECK(ver == NULL);
+  string obj_file = temp_file(".obj");
+  Model grid = make_grid(5);
+  write_file(obj_file, obj_text(grid));
+
+  Model model;
+  BOOST_REQUIRE(parse_obj_file(obj_file, model));
+  check_same_mesh(model, grid);
+
+  // Missing files are reported, not thrown
+  remove(obj_file.c_str());
+  Model missing;
+  BOOST_CHECK(!parse_obj_file(obj_file, missing));
+  BOOST_CHECK_EQUAL(missing.faces.size(), 0u);
 }
 
 BOOST_AUTO_TEST_CASE(parse_scene_desc_file_test) {
 }
+
+// Walks around boundary vertices have to reach every face and neighbour
+BOOST_AUTO_TEST_CASE(open_grid_one_ring_test) {
+  const double time_step = 0.01;
+  Model grid = make_grid(4);
+  HalfedgeMesh mesh;
+  BOOST_REQUIRE(build_HE(grid.faces, grid.vertices.size(), mesh));
+
+  // build_HE keeps the first face, so every face keeps its winding here
+  Eigen::SparseMatrix<double> F = build_F_operator(mesh, grid.vertices,
+      time_step);
+  map<pair<int, int>, double> expected = reference_F(grid, time_step);
+
+  size_t nonzeros = 0;
+  for (int k = 0; k < F.outerSize(); ++k) {
+    for (Eigen::SparseMatrix<double>::InnerIterator it(F, k); it; ++it) {
+      pair<int, int> entry(it.row() + 1, it.col() + 1);
+      BOOST_REQUIRE_MESSAGE(expected.count(entry), "unexpected F("
+          << entry.first << ", " << entry.second << ")");
+      BOOST_CHECK_CLOSE(it.value(), expected[entry], 1e-9);
+      ++nonzeros;
+    }
+  }
+  BOOST_CHECK_EQUAL(nonzeros, expected.size());
+
+  // Same normals as summing face by face
+  vector<Normal> normals;
+  vector<int> corners;
+  for (size_t f = 0; f < grid.faces.size(); ++f) {
+    corners.push_back(grid.faces[f].vertex1);
+    corners.push_back(grid.faces[f].vertex2);
+    corners.push_back(grid.faces[f].vertex3);
+  }
+  vector<uint32_t> indices(corners.begin(), corners.end());
+  calc_vertex_normals(grid.vertices, indices.data(), indices.size(), normals);
+  for (uint32_t v = 1; v < grid.vertices.size(); ++v) {
+    Normal normal = calc_vertex_normal(mesh, grid.vertices, v);
+    BOOST_CHECK_SMALL(normal.x - normals[v].x, 1e-6f);
+    BOOST_CHECK_SMALL(normal.y - normals[v].y, 1e-6f);
+    BOOST_CHECK_SMALL(normal.z - normals[v].z, 1e-6f);
+  }
+}
+
+// Copies with the same faces keep sharing one HalfedgeMesh, new faces
+// (even as many as before) get their own
+BOOST_AUTO_TEST_CASE(shared_halfedges_test) {
+  Model source = make_grid(3);
+  source.build_halfedges();
+
+  Model copy = source;
+  copy.set_variables();
+  BOOST_CHECK(copy.halfedges == source.halfedges);
+  BOOST_CHECK(copy.halfedges_current());
+
+  // Each of the two counts half of the halfedges
+  size_t halfedge_bytes = source.halfedges->memory_bytes();
+  BOOST_CHECK(halfedge_bytes >= 3 * source.faces.size() * sizeof(HE));
+  Model *holders[2] = {&source, &copy};
+  for (int k = 0; k < 2; ++k) {
+    size_t with_share = holders[k]->memory_bytes();
+    shared_ptr<const HalfedgeMesh> held;
+    held.swap(holders[k]->halfedges);
+    BOOST_CHECK_EQUAL(with_share - holders[k]->memory_bytes(),
+        halfedge_bytes / 2);
+    held.swap(holders[k]->halfedges);
+  }
+
+  // Same number of faces, different triangulation of the first square
+  Face first = copy.faces[0];
+  Face second = copy.faces[1];
+  copy.faces[0] = Face(first.vertex1, first.vertex2, second.vertex3);
+  copy.faces[1] = Face(first.vertex2, first.vertex3, second.vertex3);
+  BOOST_CHECK(!copy.halfedges_current());
+
+  copy.set_variables();
+  BOOST_CHECK(copy.halfedges != source.halfedges);
+  BOOST_CHECK(copy.halfedges_current());
+  BOOST_CHECK(source.halfedges_current());
+}
+
+BOOST_AUTO_TEST_CASE(build_HE_closed_test) {
+  vector<Face> faces = octahedron_faces();
+  HalfedgeMesh mesh;
+  BOOST_REQUIRE(build_HE(faces, 7, mesh));
+  BOOST_CHECK_EQUAL(check_halfedges(mesh, faces, 7), 0u);
+  BOOST_CHECK_EQUAL(mesh.num_components(), 1u);
+  for (uint32_t v = 1; v < 7; ++v) {
+    BOOST_CHECK_EQUAL(count_around(mesh, v), 4u);
+  }
+  // Already consistent, so every face keeps its winding
+  for (size_t f = 0; f < faces.size(); ++f) {
+    BOOST_CHECK_EQUAL(mesh.edges[3 * f + 1].vertex, faces[f].vertex2);
+  }
+
+  // Big enough to be built in several chunks
+  vector<Face> torus = torus_faces(120);
+  BOOST_REQUIRE(build_HE(torus, 120 * 120 + 1, mesh));
+  BOOST_CHECK_EQUAL(check_halfedges(mesh, torus, 120 * 120 + 1), 0u);
+  BOOST_CHECK_EQUAL(mesh.num_components(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(build_HE_open_grid_test) {
+  const int n = 5;
+  Model grid = make_grid(n);
+  HalfedgeMesh mesh;
+  BOOST_REQUIRE(build_HE(grid.faces, grid.vertices.size(), mesh));
+  BOOST_CHECK_EQUAL(check_halfedges(mesh, grid.faces, grid.vertices.size()),
+      4u * (n - 1));
+  BOOST_CHECK_EQUAL(mesh.num_components(), 1u);
+
+  // Walks from out reach every face, so boundary vertices start right
+  // after the boundary
+  vector<size_t> num_faces(grid.vertices.size(), 0);
+  for (size_t f = 0; f < grid.faces.size(); ++f) {
+    ++num_faces[grid.faces[f].vertex1];
+    ++num_faces[grid.faces[f].vertex2];
+    ++num_faces[grid.faces[f].vertex3];
+  }
+  for (uint32_t v = 1; v < grid.vertices.size(); ++v) {
+    int row = (v - 1) / n;
+    int col = (v - 1) % n;
+    bool on_boundary = row == 0 || col == 0 || row == n - 1 || col == n - 1;
+    BOOST_CHECK_EQUAL(count_around(mesh, v), num_faces[v]);
+    uint32_t before = HalfedgeMesh::prev(mesh.out[v]);
+    BOOST_CHECK_EQUAL(mesh.edges[before].flip == NO_HALFEDGE, on_boundary);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(build_HE_mixed_winding_test) {
+  vector<Face> faces = torus_faces(120);
+  reverse_faces(faces, 1, 3);
+  HalfedgeMesh mesh;
+  BOOST_REQUIRE(build_HE(faces, 120 * 120 + 1, mesh));
+  BOOST_CHECK_EQUAL(check_halfedges(mesh, faces, 120 * 120 + 1), 0u);
+
+  // Oriented like the first face, which is not one of the reversed ones
+  BOOST_CHECK_EQUAL(mesh.edges[1].vertex, faces[0].vertex2);
+  size_t num_reversed = 0;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    if (mesh.edges[3 * f + 1].vertex != (uint32_t) faces[f].vertex2) {
+      ++num_reversed;
+    }
+  }
+  BOOST_CHECK_EQUAL(num_reversed, (faces.size() + 1) / 3);
+
+  // A Mobius strip cannot be oriented
+  vector<Face> strip;
+  const int length = 8;
+  for (int k = 0; k < length; ++k) {
+    // Vertices 1 to length along one side, the other side of k is
+    // length + k + 1, joined back to the start with a half twist
+    int top = k + 1, bottom = length + k + 1;
+    int next_top = k + 2, next_bottom = length + k + 2;
+    if (k == length - 1) {
+      next_top = length + 1;
+      next_bottom = 1;
+    }
+    strip.push_back(Face(top, bottom, next_top));
+    strip.push_back(Face(next_top, bottom, next_bottom));
+  }
+  BOOST_CHECK(!build_HE(strip, 2 * length + 1, mesh));
+}
+
+BOOST_AUTO_TEST_CASE(build_HE_components_test) {
+  // Many octahedra with their faces interleaved, then a grid, one
+  // octahedron touching the grid only at a vertex
+  const int num_octahedra = 40;
+  vector<Face> octahedron = octahedron_faces();
+  Model grid = make_grid(4);
+  size_t num_vertices = grid.vertices.size();
+  vector<Face> faces;
+  for (size_t f = 0; f < octahedron.size(); ++f) {
+    for (int k = 0; k < num_octahedra; ++k) {
+      int offset = num_vertices - 1 + 6 * k;
+      faces.push_back(Face(octahedron[f].vertex1 + offset,
+            octahedron[f].vertex2 + offset, octahedron[f].vertex3 + offset));
+    }
+  }
+  faces.insert(faces.end(), grid.faces.begin(), grid.faces.end());
+  num_vertices += 6 * num_octahedra;
+  // The last octahedron's first pole is grid vertex 1
+  for (size_t f = 0; f < faces.size(); ++f) {
+    if (faces[f].vertex1 == (int) num_vertices - 6) {
+      faces[f].vertex1 = 1;
+    }
+  }
+  reverse_faces(faces, 0, 7);
+
+  HalfedgeMesh mesh;
+  BOOST_REQUIRE(build_HE(faces, num_vertices, mesh));
+  check_halfedges(mesh, faces, num_vertices);
+  BOOST_REQUIRE_EQUAL(mesh.num_components(), num_octahedra + 1u);
+
+  // In order of their first faces, and each face in order within
+  for (int c = 0; c <= num_octahedra; ++c) {
+    uint32_t begin = mesh.component_start[c];
+    uint32_t end = mesh.component_start[c + 1];
+    BOOST_CHECK_EQUAL(end - begin, c < num_octahedra ? 8u
+        : grid.faces.size());
+    BOOST_CHECK_EQUAL(mesh.component_faces[begin],
+        c < num_octahedra ? (uint32_t) c : octahedron.size() * num_octahedra);
+    for (uint32_t i = begin + 1; i < end; ++i) {
+      BOOST_CHECK(mesh.component_faces[i - 1] < mesh.component_faces[i]);
+    }
+  }
+
+  // Each oriented like its first face
+  for (int c = 0; c <= num_octahedra; ++c) {
+    uint32_t first = mesh.component_faces[mesh.component_start[c]];
+    bool reversed = first % 7 == 0;
+    for (uint32_t i = mesh.component_start[c];
+        i < mesh.component_start[c + 1]; ++i) {
+      uint32_t f = mesh.component_faces[i];
+      bool kept = mesh.edges[3 * f + 1].vertex == (uint32_t) faces[f].vertex2;
+      BOOST_CHECK_EQUAL(kept, (f % 7 == 0) == reversed);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(build_HE_non_manifold_test) {
+  // Three triangles on the edge from 1 to 2. The third takes over the
+  // first one's flip, the second keeps pointing at the first.
+  vector<Face> faces;
+  faces.push_back(Face(1, 2, 3));
+  faces.push_back(Face(2, 1, 4));
+  faces.push_back(Face(2, 1, 5));
+  HalfedgeMesh mesh;
+  build_HE(faces, 6, mesh);
+
+  BOOST_CHECK_EQUAL(mesh.num_components(), 1u);
+  BOOST_CHECK_EQUAL(mesh.edges[0].flip, 6u);
+  BOOST_CHECK_EQUAL(mesh.edges[3].flip, 0u);
+  BOOST_CHECK_EQUAL(mesh.edges[6].flip, 0u);
+  for (uint32_t he = 0; he < mesh.edges.size(); ++he) {
+    if (he % 3 != 0) {
+      BOOST_CHECK_EQUAL(mesh.edges[he].flip, NO_HALFEDGE);
+    }
+    BOOST_CHECK_EQUAL(mesh.edges[mesh.out[mesh.edges[he].vertex]].vertex,
+        mesh.edges[he].vertex);
+  }
+}
+
+// Chunks, groups and levels are merged in an order that does not depend on
+// the threads, so neither do the halfedges
+BOOST_AUTO_TEST_CASE(build_HE_threads_test) {
+  vector<Face> faces = torus_faces(150);
+  reverse_faces(faces, 2, 5);
+  size_t num_vertices = 150 * 150 + 1;
+  // Small components to orient side by side as well
+  vector<Face> octahedron = octahedron_faces();
+  for (int k = 0; k < 500; ++k) {
+    for (size_t f = 0; f < octahedron.size(); ++f) {
+      faces.push_back(Face(octahedron[f].vertex1 + num_vertices - 1,
+            octahedron[f].vertex3 + num_vertices - 1,
+            octahedron[f].vertex2 + num_vertices - 1));
+    }
+    num_vertices += 6;
+  }
+  random_shuffle(faces.begin(), faces.end());
+
+  HalfedgeMesh serial, threaded;
+  bool serial_consistent = build_HE_with(faces, num_vertices, "1", serial);
+  bool threaded_consistent = build_HE_with(faces, num_vertices, "4",
+      threaded);
+  BOOST_CHECK(serial_consistent);
+  BOOST_CHECK_EQUAL(serial_consistent, threaded_consistent);
+  check_halfedges(threaded, faces, num_vertices);
+
+  BOOST_REQUIRE_EQUAL(serial.edges.size(), threaded.edges.size());
+  for (size_t he = 0; he < serial.edges.size(); ++he) {
+    BOOST_CHECK_EQUAL(serial.edges[he].vertex, threaded.edges[he].vertex);
+    BOOST_CHECK_EQUAL(serial.edges[he].flip, threaded.edges[he].flip);
+  }
+  BOOST_CHECK(serial.out == threaded.out);
+  BOOST_CHECK(serial.component_start == threaded.component_start);
+  BOOST_CHECK(serial.component_faces == threaded.component_faces);
+}
+
+static void check_vertex(const Vertex &found, const Vertex &expected) {
+  BOOST_CHECK_SMALL(found.x - expected.x, 1e-5f);
+  BOOST_CHECK_SMALL(found.y - expected.y, 1e-5f);
+  BOOST_CHECK_SMALL(found.z - expected.z, 1e-5f);
+}
+
+// Lazy loading places copies by the box of their mesh file before loading
+// them, from one pass over the .obj or from the cache header
+BOOST_AUTO_TEST_CASE(mesh_file_bounds_test) {
+  string obj_file = temp_file(".obj");
+  Model grid = make_grid(4);
+  write_file(obj_file, obj_text(grid));
+
+  Vertex expected_min, expected_max, min_corner, max_corner;
+  grid.get_bounds(expected_min, expected_max);
+  BOOST_CHECK(!load_mesh_cache_bounds(obj_file, min_corner, max_corner));
+  BOOST_REQUIRE(mesh_file_bounds(obj_file, MeshLoadOptions(), min_corner,
+        max_corner));
+  check_vertex(min_corner, expected_min);
+  check_vertex(max_corner, expected_max);
+
+  // Loading writes the cache, whose header then has the same box
+  Model loaded = parse_file_to_model(obj_file);
+  BOOST_CHECK_EQUAL(loaded.faces.size(), grid.faces.size());
+  BOOST_REQUIRE(load_mesh_cache_bounds(obj_file, min_corner, max_corner));
+  check_vertex(min_corner, expected_min);
+  check_vertex(max_corner, expected_max);
+
+  // Rotated and moved, the box of the corners holds every vertex
+  SceneInstance instance;
+  instance.transform_lines.push_back("r 0 0 1 0.7");
+  instance.transform_lines.push_back("t 1 2 3");
+  Model copy = grid;
+  Eigen::Matrix4d trans_mat(*multiply_matrices(instance.transform_lines));
+  for (size_t v = 1; v < copy.vertices.size(); ++v) {
+    copy.vertices[v] = transform_vertex(trans_mat, copy.vertices[v]);
+  }
+  Vertex copy_min, copy_max;
+  copy.get_bounds(copy_min, copy_max);
+  transform_bounds(instance, expected_min, expected_max, min_corner,
+      max_corner);
+  BOOST_CHECK(min_corner.x <= copy_min.x + 1e-5f);
+  BOOST_CHECK(min_corner.y <= copy_min.y + 1e-5f);
+  BOOST_CHECK(min_corner.z <= copy_min.z + 1e-5f);
+  BOOST_CHECK(max_corner.x >= copy_max.x - 1e-5f);
+  BOOST_CHECK(max_corner.y >= copy_max.y - 1e-5f);
+  BOOST_CHECK(max_corner.z >= copy_max.z - 1e-5f);
+
+  remove(mesh_cache_file_name(obj_file).c_str());
+  remove(obj_file.c_str());
+}
+
+// Compressed meshes are read in the format the name without .gz gives, or
+// the name itself if it kept its own extension
+BOOST_AUTO_TEST_CASE(gzip_mesh_file_test) {
+  Model grid = make_grid(5);
+
+  string obj_file = temp_file(".obj.gz");
+  write_gzip_file(obj_file, obj_text(grid));
+  Model from_obj;
+  BOOST_REQUIRE(parse_mesh_file(obj_file, from_obj));
+  check_same_mesh(from_obj, grid);
+  remove(obj_file.c_str());
+
+  vector<char> encoded = encode_compact_mesh(grid, 20);
+  string contents(encoded.begin(), encoded.end());
+  Model expected;
+  decode_compact_mesh(encoded.data(), encoded.data() + encoded.size(),
+      expected.vertices, expected.faces);
+
+  const char *suffixes[] = {".cmesh.gz", ".cmesh"};
+  for (int k = 0; k < 2; ++k) {
+    string cmesh_file = temp_file(suffixes[k]);
+    write_gzip_file(cmesh_file, contents);
+    Model from_cmesh;
+    BOOST_REQUIRE(parse_mesh_file(cmesh_file, from_cmesh));
+    check_same_mesh(from_cmesh, expected);
+
+    // No box without decoding the whole file
+    Vertex min_corner, max_corner;
+    BOOST_CHECK(!mesh_file_bounds(cmesh_file, MeshLoadOptions(), min_corner,
+          max_corner));
+    remove(cmesh_file.c_str());
+  }
+}
+
+// A saved cache loads back as the same mesh (with the way back to the file
+// order if it was reordered) only while the source and options match
+BOOST_AUTO_TEST_CASE(mesh_cache_test) {
+  string source = temp_file(".obj");
+  Model grid = make_grid(5);
+  write_file(source, obj_text(grid));
+
+  BOOST_REQUIRE(save_mesh_cache(source, grid));
+  Model loaded;
+  BOOST_REQUIRE(load_mesh_cache(source, loaded));
+  check_same_mesh(loaded, grid);
+  BOOST_CHECK(!loaded.original_order);
+
+  // Reordered meshes keep their order payload, in their own cache file
+  MeshLoadOptions rcm;
+  rcm.ordering = ORDER_RCM;
+  Model reordered = grid;
+  reorder_mesh(reordered, ORDER_RCM);
+  BOOST_REQUIRE(save_mesh_cache(source, reordered, rcm));
+  Model loaded_rcm;
+  BOOST_REQUIRE(load_mesh_cache(source, loaded_rcm, rcm));
+  check_same_mesh(loaded_rcm, reordered);
+  BOOST_REQUIRE(loaded_rcm.original_order);
+  BOOST_CHECK(loaded_rcm.original_order->vertices
+      == reordered.original_order->vertices);
+  BOOST_CHECK(loaded_rcm.original_order->faces
+      == reordered.original_order->faces);
+  // Without the order, a reordered mesh is not saved at all
+  Model unordered = reordered;
+  unordered.original_order.reset();
+  BOOST_CHECK(!save_mesh_cache(source, unordered, rcm));
+
+  MeshLoadOptions morton;
+  morton.ordering = ORDER_MORTON;
+  Model other;
+  BOOST_CHECK(!load_mesh_cache(source, other, morton));
+
+  // A cache moved under the name of other options is still refused
+  MeshLoadOptions welded;
+  welded.weld = true;
+  BOOST_REQUIRE_EQUAL(rename(mesh_cache_file_name(source).c_str(),
+        mesh_cache_file_name(source, welded).c_str()), 0);
+  BOOST_CHECK(!load_mesh_cache(source, other, welded));
+  remove(mesh_cache_file_name(source, welded).c_str());
+
+  // Stale once the source changes size, or only its modification time
+  BOOST_REQUIRE(save_mesh_cache(source, grid));
+  write_file(source, obj_text(grid) + "# edited\n");
+  BOOST_CHECK(!load_mesh_cache(source, other));
+  Vertex min_corner, max_corner;
+  BOOST_CHECK(!load_mesh_cache_bounds(source, min_corner, max_corner));
+
+  BOOST_REQUIRE(save_mesh_cache(source, grid));
+  BOOST_REQUIRE(load_mesh_cache(source, other));
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = 1000000000;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  BOOST_REQUIRE_EQUAL(utimensat(AT_FDCWD, source.c_str(), times, 0), 0);
+  BOOST_CHECK(!load_mesh_cache(source, other));
+
+  remove(mesh_cache_file_name(source).c_str());
+  remove(mesh_cache_file_name(source, rcm).c_str());
+  remove(source.c_str());
+}
+
+// Appends the size bytes of value to out in big or little endian order
+static void append_bytes(string &out, const void *value, size_t size,
+    bool big_endian) {
+  const uint16_t probe = 1;
+  bool host_big_endian = *reinterpret_cast<const unsigned char *>(&probe) == 0;
+  unsigned char bytes[8];
+  memcpy(bytes, value, size);
+  if (big_endian != host_big_endian) {
+    reverse(bytes, bytes + size);
+  }
+  out.append(reinterpret_cast<const char *>(bytes), size);
+}
+
+// A square of two triangles and a quad on the side, with properties the
+// parser has to skip
+static Model ply_expected() {
+  Model model;
+  model.vertices.push_back(Vertex(0, 0, 0));
+  model.vertices.push_back(Vertex(1, 0, 0));
+  model.vertices.push_back(Vertex(1, 1, 0.5));
+  model.vertices.push_back(Vertex(0, 1, -0.25));
+  model.vertices.push_back(Vertex(2, 0, 0));
+  model.vertices.push_back(Vertex(2, 1, 0));
+  model.faces.push_back(Face(1, 2, 3));
+  model.faces.push_back(Face(1, 3, 4));
+  // The quad 1 4 5 2 (0-based) is split into a fan
+  model.faces.push_back(Face(2, 5, 6));
+  model.faces.push_back(Face(2, 6, 3));
+  return model;
+}
+
+BOOST_AUTO_TEST_CASE(ply_ascii_test) {
+  const char text[] =
+    "ply\r\n"
+    "format ascii 1.0\n"
+    "comment made by hand\n"
+    "element vertex 6\n"
+    "property float x\n"
+    "property uchar red\n"
+    "property float y\n"
+    "property float z\n"
+    "property list uchar float weights\n"
+    "element face 3\n"
+    "property uchar flags\n"
+    "property list uchar int vertex_indices\n"
+    "element edge 1\n"
+    "property int vertex1\n"
+    "property int vertex2\n"
+    "end_header\n"
+    "0 255 0 0 0\n"
+    "1 0 0 0 2 0.5 0.5\n"
+    "1 7 1 0.5 1 1\n"
+    "0 1 1 -0.25 0\n"
+    "2 0 0 0 3 1 2 3\n"
+    "2 0 1 0 0\n"
+    "1 3 0 1 2\n"
+    "0 3 0 2 3\n"
+    "9 4 1 4 5 2\n"
+    "0 1\n";
+  const char *end = text + strlen(text);
+
+  PlyHeader header = parse_ply_header(text, end);
+  BOOST_CHECK_EQUAL(header.format, PLY_ASCII);
+  BOOST_REQUIRE_EQUAL(header.elements.size(), 3u);
+  BOOST_CHECK_EQUAL(header.elements[0].count, 6u);
+  BOOST_CHECK_EQUAL(header.elements[0].properties.size(), 5u);
+  BOOST_CHECK(header.elements[0].properties[4].is_list);
+  BOOST_CHECK_EQUAL(header.elements[1].name, "face");
+  BOOST_CHECK_EQUAL(header.elements[1].count, 3u);
+  BOOST_CHECK_EQUAL(string(text + header.data_offset, 5), "0 255");
+
+  Model model;
+  parse_ply_buffer(text, end, model.vertices, model.faces);
+  check_same_mesh(model, ply_expected());
+
+  // The same fixture read from a file
+  string file_name = temp_file(".ply");
+  write_file(file_name, text);
+  Model from_file;
+  BOOST_REQUIRE(parse_ply_file(file_name, from_file));
+  check_same_mesh(from_file, ply_expected());
+  remove(file_name.c_str());
+
+  const char bad_magic[] = "plx\nformat ascii 1.0\nend_header\n";
+  BOOST_CHECK_THROW(parse_ply_header(bad_magic, bad_magic + strlen(bad_magic)),
+      const char *);
+  const char no_end[] = "ply\nformat ascii 1.0\nelement vertex 1\n";
+  BOOST_CHECK_THROW(parse_ply_header(no_end, no_end + strlen(no_end)),
+      const char *);
+}
+
+// Binary files in both byte orders, once as plain float x, y, z (copied
+// as a block in the host order) and once with properties in between
+BOOST_AUTO_TEST_CASE(ply_binary_test) {
+  Model expected = ply_expected();
+  const int32_t polygons[3][5] = {
+    {3, 0, 1, 2}, {3, 0, 2, 3}, {4, 1, 4, 5, 2}
+  };
+
+  for (int order = 0; order < 2; ++order) {
+    bool big_endian = order == 1;
+    for (int extra = 0; extra < 2; ++extra) {
+      string data = string("ply\n")
+        + "format " + (big_endian ? "binary_big_endian" : "binary_little_endian")
+        + " 1.0\n"
+        + "element vertex 6\n"
+        + "property float x\n"
+        + (extra ? "property ushort red\n" : "")
+        + "property float y\n"
+        + (extra ? "property double z\n" : "property float z\n")
+        + "element face 3\n"
+        + (extra ? "property int flags\n" : "")
+        + "property list uchar int vertex_indices\n"
+        + "end_header\n";
+
+      for (size_t v = 1; v < expected.vertices.size(); ++v) {
+        const Vertex &vertex = expected.vertices[v];
+        append_bytes(data, &vertex.x, sizeof(float), big_endian);
+        if (extra) {
+          uint16_t red = 0x1234;
+          append_bytes(data, &red, sizeof(red), big_endian);
+        }
+        append_bytes(data, &vertex.y, sizeof(float), big_endian);
+        if (extra) {
+          double z = vertex.z;
+          append_bytes(data, &z, sizeof(z), big_endian);
+        } else {
+          append_bytes(data, &vertex.z, sizeof(float), big_endian);
+        }
+      }
+      for (int f = 0; f < 3; ++f) {
+        if (extra) {
+          int32_t flags = -1;
+          append_bytes(data, &flags, sizeof(flags), big_endian);
+        }
+        data.push_back(char(polygons[f][0]));
+        for (int k = 1; k <= polygons[f][0]; ++k) {
+          append_bytes(data, &polygons[f][k], sizeof(int32_t), big_endian);
+        }
+      }
+
+      PlyHeader header = parse_ply_header(data.data(),
+          data.data() + data.size());
+      BOOST_CHECK_EQUAL(header.format,
+          big_endian ? PLY_BINARY_BE : PLY_BINARY_LE);
+      BOOST_CHECK_EQUAL(header.elements[0].properties.size(),
+          extra ? 4u : 3u);
+
+      Model model;
+      parse_ply_buffer(data.data(), data.data() + data.size(),
+          model.vertices, model.faces);
+      check_same_mesh(model, expected);
+
+      // Cut short, the body runs out
+      Model truncated;
+      BOOST_CHECK_THROW(parse_ply_buffer(data.data(),
+            data.data() + data.size() - 1, truncated.vertices,
+            truncated.faces), const char *);
+    }
+  }
+}
+
+// write_ply_file output reads back to the same Model
+BOOST_AUTO_TEST_CASE(ply_write_read_test) {
+  Model grid = make_grid(6);
+  grid.vertices[7].x = 1.0f / 3;
+  grid.vertices[8].z = -1e-30f;
+
+  string file_name = temp_file(".ply");
+  BOOST_REQUIRE(write_ply_file(file_name, grid));
+  Model loaded;
+  BOOST_REQUIRE(parse_ply_file(file_name, loaded));
+  check_same_mesh(loaded, grid);
+  remove(file_name.c_str());
+}
+
+// The corners of face rotated so the smallest comes first, keeping the
+// winding, as (first, second, third)
+static vector<int> face_key(const Face &face) {
+  int corners[3] = {face.vertex1, face.vertex2, face.vertex3};
+  int first = min_element(corners, corners + 3) - corners;
+  vector<int> key;
+  for (int k = 0; k < 3; ++k) {
+    key.push_back(corners[(first + k) % 3]);
+  }
+  return key;
+}
+
+static vector<vector<int> > sorted_face_keys(const vector<Face> &faces) {
+  vector<vector<int> > keys;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    keys.push_back(face_key(faces[f]));
+  }
+  sort(keys.begin(), keys.end());
+  return keys;
+}
+
+// Decoded positions are within the reported error and the faces come back
+// as the same triangles with the same winding, only rotated and re-sorted
+BOOST_AUTO_TEST_CASE(compact_mesh_test) {
+  Model model = make_grid(9);
+  for (size_t v = 1; v < model.vertices.size(); ++v) {
+    model.vertices[v].x += 0.01f * sin(float(v));
+    model.vertices[v].z -= 3.5f * cos(0.3f * v);
+  }
+  // Faces out of order and starting at different corners
+  reverse(model.faces.begin(), model.faces.end());
+  for (size_t f = 0; f < model.faces.size(); f += 3) {
+    Face &face = model.faces[f];
+    face = Face(face.vertex2, face.vertex3, face.vertex1);
+  }
+
+  double previous_error = HUGE_VAL;
+  const int bits[] = {4, 10, 16, 24};
+  for (int k = 0; k < 4; ++k) {
+    CompactMeshInfo info;
+    vector<char> encoded = encode_compact_mesh(model, bits[k], &info);
+    BOOST_CHECK_EQUAL(info.file_size, encoded.size());
+    BOOST_CHECK(info.max_error <= previous_error);
+    previous_error = info.max_error;
+
+    Model decoded;
+    decode_compact_mesh(encoded.data(), encoded.data() + encoded.size(),
+        decoded.vertices, decoded.faces);
+    BOOST_REQUIRE_EQUAL(decoded.vertices.size(), model.vertices.size());
+    for (size_t v = 1; v < model.vertices.size(); ++v) {
+      BOOST_CHECK(fabs(decoded.vertices[v].x - model.vertices[v].x)
+          <= info.max_error);
+      BOOST_CHECK(fabs(decoded.vertices[v].y - model.vertices[v].y)
+          <= info.max_error);
+      BOOST_CHECK(fabs(decoded.vertices[v].z - model.vertices[v].z)
+          <= info.max_error);
+    }
+    BOOST_REQUIRE_EQUAL(decoded.faces.size(), model.faces.size());
+    BOOST_CHECK(sorted_face_keys(decoded.faces)
+        == sorted_face_keys(model.faces));
+  }
+  BOOST_CHECK(previous_error < 1e-5);
+
+  // Through a file, and cut short
+  string file_name = temp_file(".cmesh");
+  CompactMeshInfo info;
+  BOOST_REQUIRE(write_compact_mesh(file_name, model, 16, &info));
+  Model loaded;
+  BOOST_REQUIRE(parse_compact_mesh_file(file_name, loaded));
+  BOOST_CHECK(sorted_face_keys(loaded.faces) == sorted_face_keys(model.faces));
+  remove(file_name.c_str());
+
+  vector<char> encoded = encode_compact_mesh(model, 16);
+  Model truncated;
+  BOOST_CHECK_THROW(decode_compact_mesh(encoded.data(),
+        encoded.data() + encoded.size() - 1, truncated.vertices,
+        truncated.faces), const char *);
+  BOOST_CHECK_THROW(encode_compact_mesh(model, 31), const char *);
+}
+
+static string formatted_float(float value) {
+  char text[FORMAT_NUMBER_MAX];
+  return string(text, format_float(value, text));
+}
+
+// format_float gives text strtof and scan_float read back to the same
+// float, for bit patterns spread over every exponent
+BOOST_AUTO_TEST_CASE(format_float_test) {
+  BOOST_CHECK_EQUAL(formatted_float(0), "0");
+  BOOST_CHECK_EQUAL(formatted_float(1), "1");
+  BOOST_CHECK_EQUAL(formatted_float(0.1f), "0.1");
+  BOOST_CHECK_EQUAL(formatted_float(-2.5f), "-2.5");
+  BOOST_CHECK_EQUAL(formatted_float(1.0f / 3), "0.33333334");
+
+  for (int i = 0; i < (1 << 18); ++i) {
+    // Every 16384th pattern, moved around within the step
+    uint32_t bits = (uint32_t(i) << 14) | ((uint32_t(i) * 2654435761u) >> 18);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    if (value != value) {
+      continue;
+    }
+
+    string text = formatted_float(value);
+    float parsed = strtof(text.c_str(), NULL);
+    if (parsed != value) {
+      BOOST_ERROR("format_float(" << bits << ") gave " << text);
+    }
+    const char *p = text.data();
+    float scanned;
+    if (!scan_float(p, text.data() + text.size(), scanned)
+        || scanned != value) {
+      BOOST_ERROR("scan_float(format_float(" << bits << ")) gave "
+          << scanned);
+    }
+  }
+
+  char text[FORMAT_NUMBER_MAX];
+  BOOST_CHECK_EQUAL(string(text, format_int(0, text)), "0");
+  BOOST_CHECK_EQUAL(string(text, format_int(-45, text)), "-45");
+  BOOST_CHECK_EQUAL(string(text, format_int(2147483647, text)), "2147483647");
+  BOOST_CHECK_EQUAL(string(text, format_int(-2147483647 - 1, text)),
+      "-2147483648");
+}
+
+// A written .obj parses back to exactly the Model it came from, written
+// serially or on all threads
+BOOST_AUTO_TEST_CASE(obj_write_read_test) {
+  Model grid = make_grid(40);
+  grid.vertices[1].x = 1.0f / 3;
+  grid.vertices[2].y = -1e-30f;
+  grid.vertices[3].z = 3e38f;
+  grid.vertices[4].x = 1e-40f;
+  grid.vertices[5].y = 16777216.0f;
+
+  string serial_file = temp_file(".obj");
+  string parallel_file = temp_file(".obj");
+  MeshWriteOptions serial;
+  serial.parallel = false;
+  BOOST_REQUIRE(write_obj_file(serial_file, grid, serial));
+  BOOST_REQUIRE(write_obj_file(parallel_file, grid));
+
+  Model from_serial, from_parallel;
+  BOOST_REQUIRE(parse_obj_file(serial_file, from_serial));
+  BOOST_REQUIRE(parse_obj_file(parallel_file, from_parallel));
+  check_same_mesh(from_serial, grid);
+  check_same_mesh(from_parallel, grid);
+
+  // Reordered meshes are written in the order they were read in
+  Model reordered = grid;
+  reorder_mesh(reordered, ORDER_RCM);
+  BOOST_REQUIRE(write_mesh_file(serial_file, reordered));
+  Model restored;
+  BOOST_REQUIRE(parse_obj_file(serial_file, restored));
+  check_same_mesh(restored, grid);
+
+  remove(serial_file.c_str());
+  remove(parallel_file.c_str());
+}
+
+static void check_faces(const Model &model, const int (*expected)[3],
+    size_t num_faces) {
+  BOOST_REQUIRE_EQUAL(model.faces.size(), num_faces);
+  for (size_t f = 0; f < num_faces; ++f) {
+    BOOST_CHECK_EQUAL(model.faces[f].vertex1, expected[f][0]);
+    BOOST_CHECK_EQUAL(model.faces[f].vertex2, expected[f][1]);
+    BOOST_CHECK_EQUAL(model.faces[f].vertex3, expected[f][2]);
+  }
+}
+
+// Groups merge through chains of close vertices (and across cell
+// borders) into their first vertex, and faces left with a repeated corner
+// are dropped
+BOOST_AUTO_TEST_CASE(weld_vertices_test) {
+  Model model;
+  model.vertices.push_back(Vertex(0, 0, 0));
+  model.vertices.push_back(Vertex(1, 0, 0));
+  model.vertices.push_back(Vertex(0, 1, 0));
+  // 4 is close to 1, and 5 only to 4
+  model.vertices.push_back(Vertex(0.08, 0, 0));
+  model.vertices.push_back(Vertex(0.16, 0, 0));
+  model.vertices.push_back(Vertex(1, 0, 0.05));
+  model.vertices.push_back(Vertex(0, 1, 0));
+  model.vertices.push_back(Vertex(5, 5, 5));
+  model.vertices.push_back(Vertex(5, 5, 5.3));
+  // In the cell below 8 along x
+  model.vertices.push_back(Vertex(4.95, 5, 5));
+  model.vertices.push_back(Vertex(-0.0, 1, 0));
+  model.faces.push_back(Face(1, 2, 3));
+  model.faces.push_back(Face(4, 6, 7));
+  model.faces.push_back(Face(1, 4, 2));
+  model.faces.push_back(Face(5, 8, 9));
+  model.faces.push_back(Face(4, 5, 3));
+  model.faces.push_back(Face(10, 9, 2));
+  model.faces.push_back(Face(3, 7, 2));
+  model.faces.push_back(Face(11, 5, 2));
+
+  // Only identical positions (0 and -0 alike) merge with epsilon 0
+  Model exact = model;
+  WeldStats stats = weld_vertices(exact, 0);
+  BOOST_CHECK_EQUAL(stats.merged_vertices, 2u);
+  BOOST_CHECK_EQUAL(stats.dropped_faces, 1u);
+  BOOST_REQUIRE_EQUAL(exact.vertices.size(), 10u);
+  check_vertex(exact.vertices[7], Vertex(5, 5, 5));
+  const int exact_faces[][3] = {
+    {1, 2, 3}, {4, 6, 3}, {1, 4, 2}, {5, 7, 8}, {4, 5, 3}, {9, 8, 2},
+    {3, 5, 2}
+  };
+  check_faces(exact, exact_faces, 7);
+
+  stats = weld_vertices(model, 0.1f);
+  BOOST_CHECK_EQUAL(stats.merged_vertices, 6u);
+  BOOST_CHECK_EQUAL(stats.dropped_faces, 3u);
+  BOOST_REQUIRE_EQUAL(model.vertices.size(), 6u);
+  // The first of each group survives, in the old order
+  check_vertex(model.vertices[1], Vertex(0, 0, 0));
+  check_vertex(model.vertices[2], Vertex(1, 0, 0));
+  check_vertex(model.vertices[3], Vertex(0, 1, 0));
+  check_vertex(model.vertices[4], Vertex(5, 5, 5));
+  check_vertex(model.vertices[5], Vertex(5, 5, 5.3));
+  const int welded_faces[][3] = {
+    {1, 2, 3}, {1, 2, 3}, {1, 4, 5}, {4, 5, 2}, {3, 1, 2}
+  };
+  check_faces(model, welded_faces, 5);
+
+  // Nothing left to merge
+  stats = weld_vertices(model, 0.1f);
+  BOOST_CHECK_EQUAL(stats.merged_vertices, 0u);
+  BOOST_CHECK_EQUAL(model.faces.size(), 5u);
+
+  // A duplicate so there is something to remap
+  Model broken = model;
+  broken.vertices.push_back(Vertex(0, 0, 0));
+  broken.faces.push_back(Face(1, 2, 7));
+  BOOST_CHECK_THROW(weld_vertices(broken, 0.1f), const char *);
+}
+
+// A grid with its own copy of the corners of every face (over several
+// chunks of the parallel passes) welds back to the shared corners
+BOOST_AUTO_TEST_CASE(weld_split_grid_test) {
+  Model grid = make_grid(80);
+  Model split;
+  for (size_t f = 0; f < grid.faces.size(); ++f) {
+    const Face &face = grid.faces[f];
+    split.vertices.push_back(grid.vertices[face.vertex1]);
+    split.vertices.push_back(grid.vertices[face.vertex2]);
+    split.vertices.push_back(grid.vertices[face.vertex3]);
+    int first = 3 * f + 1;
+    split.faces.push_back(Face(first, first + 1, first + 2));
+  }
+
+  WeldStats stats = weld_vertices(split, 1e-4f);
+  BOOST_CHECK_EQUAL(stats.merged_vertices,
+      3 * grid.faces.size() - (grid.vertices.size() - 1));
+  BOOST_CHECK_EQUAL(stats.dropped_faces, 0u);
+  BOOST_REQUIRE_EQUAL(split.vertices.size(), grid.vertices.size());
+  BOOST_REQUIRE_EQUAL(split.faces.size(), grid.faces.size());
+  for (size_t f = 0; f < grid.faces.size(); ++f) {
+    check_vertex(split.vertices[split.faces[f].vertex1],
+        grid.vertices[grid.faces[f].vertex1]);
+    check_vertex(split.vertices[split.faces[f].vertex3],
+        grid.vertices[grid.faces[f].vertex3]);
+  }
+}
+
+// make_grid(n) with its vertices and faces shuffled, as a scan might list
+// them
+static Model shuffled_grid(int n) {
+  Model grid = make_grid(n);
+  size_t num_vertices = grid.vertices.size() - 1;
+  // Multiplying by a number prime to num_vertices permutes [0, num_vertices)
+  vector<int> new_index(grid.vertices.size(), 0);
+  Model shuffled = grid;
+  for (size_t v = 0; v < num_vertices; ++v) {
+    size_t moved = (v * 7919 + 13) % num_vertices;
+    new_index[v + 1] = moved + 1;
+    shuffled.vertices[moved + 1] = grid.vertices[v + 1];
+  }
+  size_t num_faces = grid.faces.size();
+  for (size_t f = 0; f < num_faces; ++f) {
+    const Face &face = grid.faces[(f * 104729 + 7) % num_faces];
+    shuffled.faces[f] = Face(new_index[face.vertex1], new_index[face.vertex2],
+        new_index[face.vertex3]);
+  }
+  return shuffled;
+}
+
+// Reordering keeps the mesh (only renumbered, faces by smallest corner)
+// and restore_file_order gives back exactly the input, also after two
+// reorderings
+BOOST_AUTO_TEST_CASE(reorder_mesh_test) {
+  Model input = shuffled_grid(150);
+  const MeshOrdering orderings[] = {ORDER_RCM, ORDER_MORTON};
+
+  for (int k = 0; k < 2; ++k) {
+    Model model = input;
+    ReorderStats stats = reorder_mesh(model, orderings[k]);
+    BOOST_REQUIRE(model.original_order);
+    BOOST_REQUIRE_EQUAL(model.vertices.size(), input.vertices.size());
+    BOOST_REQUIRE_EQUAL(model.faces.size(), input.faces.size());
+    if (orderings[k] == ORDER_RCM) {
+      BOOST_CHECK(stats.bandwidth_after <= stats.bandwidth_before);
+      // Far below the shuffled order for a grid
+      BOOST_CHECK(stats.bandwidth_after < stats.bandwidth_before / 10);
+    }
+
+    const MeshOrder &order = *model.original_order;
+    int previous_smallest = 0;
+    for (size_t f = 0; f < model.faces.size(); ++f) {
+      const Face &face = model.faces[f];
+      const Face &file_face = input.faces[order.faces[f]];
+      BOOST_CHECK_EQUAL(order.vertices[face.vertex1], file_face.vertex1);
+      BOOST_CHECK_EQUAL(order.vertices[face.vertex2], file_face.vertex2);
+      BOOST_CHECK_EQUAL(order.vertices[face.vertex3], file_face.vertex3);
+      int smallest = min(face.vertex1, min(face.vertex2, face.vertex3));
+      BOOST_CHECK(smallest >= previous_smallest);
+      previous_smallest = smallest;
+    }
+
+    Model restored;
+    restore_file_order(model, restored);
+    check_same_mesh(restored, input);
+
+    // The second ordering still leads back to the file
+    reorder_mesh(model, orderings[1 - k]);
+    Model restored_twice;
+    restore_file_order(model, restored_twice);
+    check_same_mesh(restored_twice, input);
+  }
+
+  // A plain copy without a reordering
+  Model copy;
+  restore_file_order(input, copy);
+  check_same_mesh(copy, input);
+}